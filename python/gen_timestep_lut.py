@@ -0,0 +1,107 @@
+"""Generate the multi level time step LUT searched by mjt.c (see multi_stage_binary_mjt_timestep_search()).
+
+A time step is built digit by digit in base B (branching factor) on top of the resolution r:
+    level 0        r*B^k for k = k_min..L, the first candidate reaching the step gives its magnitude
+    level 1..L     d*r*B^(L-j) for d = 1..B-1, one digit of the time step per level
+L is the smallest depth whose largest time step r*B^L covers the maximum interval, k_min the magnitude of the
+minimum interval, so only the levels the configured interval range needs are emitted.
+Intervals above the maximum are still handled (slower) by mjt.c, the maximum is a performance knob.
+
+Called by CMakeLists.txt with the Kconfig values, no dependency other than the python standard library.
+
+Example:
+    python gen_timestep_lut.py --min-interval-us 20 --max-interval-us 5000 --resolution-us 2 --branching 10 --output mjt_mutli_level_timestep_lut.h
+"""
+import argparse
+import sys
+
+
+def timestep_lut_levels(min_interval_us, max_interval_us, resolution_us, branching):
+    """Candidates [us] of each level, level 0 first."""
+    n_levels = 1
+    while resolution_us * branching**n_levels <= max_interval_us:
+        n_levels += 1
+
+    first_power = 0
+    while first_power < n_levels and resolution_us * branching**(first_power + 1) <= min_interval_us:
+        first_power += 1
+
+    levels = [[resolution_us * branching**k for k in range(first_power, n_levels + 1)]]
+    for j in range(1, n_levels + 1):
+        levels.append([d * resolution_us * branching**(n_levels - j) for d in range(1, branching)])
+
+    return levels, first_power
+
+
+def worst_case_evaluations(levels):
+    """Trajectory evaluations per step: linear scan of level 0, then every level (binary search / vector search)."""
+    n_level0 = len(levels[0])
+    binary = n_level0 + sum(len(level).bit_length() for level in levels[1:])
+    vector = n_level0 + sum(len(level) for level in levels[1:])
+    return binary, vector
+
+
+def write_timestep_lut_header(path, levels, first_power, resolution_us, branching):
+    def seconds(values):
+        return ','.join(f'{v * 1e-6:.8g}' for v in values)
+
+    def seconds_f32(values):
+        return ','.join(f'{v * 1e-6:.8g}f' for v in values)
+
+    with open(path, 'w') as f:
+        f.write('// generated by python/gen_timestep_lut.py - do not edit\n')
+        f.write('#ifndef MJT_MULTI_LEVEL_TIMESTEP_LUT_H\n')
+        f.write('#define MJT_MULTI_LEVEL_TIMESTEP_LUT_H\n\n')
+        f.write('#include <stdint.h>\n\n')
+        f.write(f'#define MJT_UNIT_TS {resolution_us * 1e-6:.8g}\n')
+        f.write(f'#define MJT_TS_LUT_BRANCHING {branching}\n')
+        f.write(f'#define MJT_TS_LUT_N_LEVELS {len(levels) - 1}\n')
+        f.write(f'#define MJT_TS_LUT_LEVEL0_FIRST_POWER {first_power}\n')
+        f.write(f'#define TS_LUT_LEVEL0_SIZE {len(levels[0])}\n\n')
+        for j, level in enumerate(levels):
+            f.write(f'const double ts_lut_level{j}[] = {{{seconds(level)}}};\n')
+        f.write('\n')
+        f.write('const double* const ts_lut_levels[] = {')
+        f.write(','.join(f'ts_lut_level{j}' for j in range(len(levels))))
+        f.write('};\n')
+        f.write('const uint8_t ts_lut_level_sizes[] = {')
+        f.write(','.join(str(len(level)) for level in levels))
+        f.write('};\n\n')
+        f.write('// single precision copy for MJT_ENGINE_LUT_VECTOR_SEARCH (hardware FPU on the ESP32-S3)\n')
+        for j, level in enumerate(levels):
+            f.write(f'const float ts_lut_level{j}_f32[] = {{{seconds_f32(level)}}};\n')
+        f.write('const float* const ts_lut_levels_f32[] = {')
+        f.write(','.join(f'ts_lut_level{j}_f32' for j in range(len(levels))))
+        f.write('};\n\n')
+        f.write('#endif\n')
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Generate the multi level time step LUT of mjt.c.')
+    parser.add_argument('--min-interval-us', type=int, required=True, help='shortest step interval [us]')
+    parser.add_argument('--max-interval-us', type=int, required=True, help='longest step interval covered by the LUT [us]')
+    parser.add_argument('--resolution-us', type=int, required=True, help='time step resolution [us]')
+    parser.add_argument('--branching', type=int, required=True, help='candidates per level + 1, base of the time step digits')
+    parser.add_argument('--output', required=True, help='header to write')
+    args = parser.parse_args()
+
+    if args.resolution_us < 1 or args.branching < 2 or args.branching > 256:
+        print('gen_timestep_lut: resolution must be >= 1 us and branching within 2..256', file=sys.stderr)
+        return 1
+    if args.min_interval_us < args.resolution_us or args.max_interval_us < args.min_interval_us:
+        print('gen_timestep_lut: expected resolution <= min interval <= max interval', file=sys.stderr)
+        return 1
+
+    levels, first_power = timestep_lut_levels(args.min_interval_us, args.max_interval_us, args.resolution_us, args.branching)
+    write_timestep_lut_header(args.output, levels, first_power, args.resolution_us, args.branching)
+
+    flash_bytes = 12 * sum(len(level) for level in levels) + 8 * len(levels) + len(levels)
+    binary, vector = worst_case_evaluations(levels)
+    print(f'timestep LUT: {len(levels) - 1} levels, {flash_bytes} bytes of flash, '
+          f'worst case {binary} evaluations per step (binary search), {vector} (vector search)')
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -1,9 +1,19 @@
+import struct
+import zlib
+
 import sympy as sym
 import matplotlib.pyplot as plt
 import numpy as np
 from scipy.optimize import curve_fit
 
 
+# motion program format - see src/core/no_jerky_program.h
+NO_JERKY_PROGRAM_MAGIC = 0x504D4A4E    # "NJMP"
+NO_JERKY_PROGRAM_VERSION = 1
+NO_JERKY_PROGRAM_HEADER = struct.Struct('<IHBBIII')
+NO_JERKY_PROGRAM_SEGMENT = struct.Struct('<II')
+
+
 def mjt_symbolic_coefficients():
     """Solve for MJT coefficients using symbolic math."""
     x0 = sym.symbols('x0')
@@ -139,70 +149,127 @@ def max_velocity_to_trajectory_duration_equations():
     plt.tight_layout()
 
 
-def gen_timestep_array_headers():
-    start_ts = 2e-6
-    end_ts = 0.4
-    dt = 2e-6
-
-    ts_lut_level0 = [2e-6, 1e-5, 1e-4, 1e-3, 1e-2, 1e-1, 1]
-    ts_lut_level1 = np.arange(1e-1, 1, 1e-1)
-    ts_lut_level2 = np.arange(1e-2, 1e-1, 1e-2)
-    ts_lut_level3 = np.arange(1e-3, 1e-2, 1e-3)
-    ts_lut_level4 = np.arange(1e-4, 1e-3, 1e-4)
-    ts_lut_level5 = np.arange(1e-5, 1e-4, 1e-5)
-    ts_lut_level6 = np.arange(2e-6, 1e-5, 2e-6)
-
-    # write to a header file
-    with open('generated_headers/mjt_mutli_level_timestep_lut.h', 'w') as f:
-        f.write('#ifndef MJT_MULTI_LEVEL_TIMESTEP_LUT_H\n')
-        f.write('#define MJT_MULTI_LEVEL_TIMESTEP_LUT_H\n\n')
-        f.write(f'#define MJT_UNIT_TS 2e-6\n')
-        f.write(f'#define TS_LUT_LEVEL0_SIZE {len(ts_lut_level0)}\n')
-        f.write(f'#define TS_LUT_LEVEL1_SIZE {len(ts_lut_level1)}\n')
-        f.write(f'#define TS_LUT_LEVEL2_SIZE {len(ts_lut_level2)}\n')
-        f.write(f'#define TS_LUT_LEVEL3_SIZE {len(ts_lut_level3)}\n')
-        f.write(f'#define TS_LUT_LEVEL4_SIZE {len(ts_lut_level4)}\n')
-        f.write(f'#define TS_LUT_LEVEL5_SIZE {len(ts_lut_level5)}\n')
-        f.write(f'#define TS_LUT_LEVEL6_SIZE {len(ts_lut_level6)}\n\n')
-        f.write('const double ts_lut_level0[] = {')
-        f.write(','.join([str(round(i, 8)) for i in ts_lut_level0]))
-        f.write('};\n')
-        f.write('const double ts_lut_level1[] = {')
-        f.write(','.join([str(round(i, 8)) for i in ts_lut_level1]))
-        f.write('};\n')
-        f.write('const double ts_lut_level2[] = {')
-        f.write(','.join([str(round(i, 8)) for i in ts_lut_level2]))
-        f.write('};\n')
-        f.write('const double ts_lut_level3[] = {')
-        f.write(','.join([str(round(i, 8)) for i in ts_lut_level3]))
-        f.write('};\n')
-        f.write('const double ts_lut_level4[] = {')
-        f.write(','.join([str(round(i, 8)) for i in ts_lut_level4]))
-        f.write('};\n')
-        f.write('const double ts_lut_level5[] = {')
-        f.write(','.join([str(round(i, 8)) for i in ts_lut_level5]))
-        f.write('};\n')
-        f.write('const double ts_lut_level6[] = {')
-        f.write(','.join([str(round(i, 8)) for i in ts_lut_level6]))
-        f.write('};\n\n')
-        f.write('#endif')
-
-    ts_lut = np.arange(start_ts, end_ts, dt)
-
-    # write to a header file
-    with open('generated_headers/mjt_timestep_lut.h', 'w') as f:
-        f.write('#ifndef MJT_TIMESTEP_LUT_H\n')
-        f.write('#define MJT_TIMESTEP_LUT_H\n\n')
-        f.write(f'#define TS_LUT_SIZE {len(ts_lut)}\n\n')
-        f.write('const double mjt_ts_lut[] = {')
-        f.write(','.join([str(round(i, 8)) for i in ts_lut]))
-        f.write('};\n\n')
-        f.write('#endif')
+def gen_mjt_dt_array(xT, T, dx):
+    """Rest to rest MJT from 0 to xT in T [s], as one time step [us] per step distance dx.
+    Same stepping rule as mjt_constexpr.h: each step lands on the first us at which the trajectory covers it."""
+    c3 = 10 * xT / T**3
+    c4 = -15 * xT / T**4
+    c5 = 6 * xT / T**5
+
+    def distance(t_us):
+        t = t_us * 1e-6
+        return t*t*t*(c3 + t*(c4 + t*c5))
+
+    dt_array = []
+    x_stepped = 0
+    last_step_us = 0
+    T_us = int(T * 1000000)
+
+    while x_stepped < xT:
+        x_stepped += dx
+        x_target = min(x_stepped, xT)
+
+        low, high = last_step_us, T_us
+        while low < high:
+            mid = (low + high) // 2
+            if distance(mid) >= x_target:
+                high = mid
+            else:
+                low = mid + 1
+
+        dt_array.append(high - last_step_us)
+        last_step_us = high
+
+    return dt_array
+
+
+def dt_array_to_rmt_symbols(dt_array):
+    """Convert time steps [us] into raw rmt_symbol_word_t values, same rule as esp32s3_stepper_curve_to_rmt_symbol()."""
+    def word(duration0, level0, duration1, level1):
+        return (duration0 & 0x7FFF) | (level0 << 15) | ((duration1 & 0x7FFF) << 16) | (level1 << 31)
+
+    symbols = []
+    for dt in dt_array:
+        if dt <= 0x8000:
+            symbols.append(word(dt >> 1, 1, dt >> 1, 0))
+            continue
+
+        n_shifts = 9
+        for k in range(1, 10):
+            if (dt >> (k + 1)) < 0x8000:    # 0x8000 would read as 0, the RMT end marker
+                n_shifts = k
+                break
+
+        duration = dt >> (n_shifts + 1)
+        symbols += [word(duration, 1, duration, 1)] * (1 << (n_shifts - 1))
+        symbols += [word(duration, 0, duration, 0)] * (1 << (n_shifts - 1))
+
+    return symbols
+
+
+def write_motion_program(path, segments):
+    """Write a multi-axis motion program for play_no_jerky_program().
+
+    segments: list of segments, each one a list (one entry per axis) of raw RMT symbols ([] if the axis is idle).
+              All axes are synchronised at the end of every segment.
+    """
+    n_axes = len(segments[0])
+    segment_table = []
+    symbols = []
+
+    for segment in segments:
+        if len(segment) != n_axes:
+            raise ValueError('every segment must have one symbol stream per axis')
+
+        for axis_symbols in segment:
+            segment_table.append((len(symbols), len(axis_symbols)))
+            symbols += axis_symbols
+
+    body = b''.join(NO_JERKY_PROGRAM_SEGMENT.pack(*s) for s in segment_table)
+    body += struct.pack(f'<{len(symbols)}I', *symbols)
+
+    header = NO_JERKY_PROGRAM_HEADER.pack(NO_JERKY_PROGRAM_MAGIC, NO_JERKY_PROGRAM_VERSION, n_axes, 0,
+                                          len(segments), len(symbols), zlib.crc32(body))
+
+    with open(path, 'wb') as f:
+        f.write(header + body)
+
+
+def read_motion_program(path):
+    """Read and validate a motion program, returns the segments in the same form as write_motion_program()."""
+    with open(path, 'rb') as f:
+        data = f.read()
+
+    magic, version, n_axes, _, n_segments, n_symbols, crc = NO_JERKY_PROGRAM_HEADER.unpack_from(data, 0)
+    if magic != NO_JERKY_PROGRAM_MAGIC:
+        raise ValueError('not a motion program')
+    if version != NO_JERKY_PROGRAM_VERSION:
+        raise ValueError(f'unsupported motion program version {version}')
+
+    body_size = n_segments * n_axes * NO_JERKY_PROGRAM_SEGMENT.size + n_symbols * 4
+    body = data[NO_JERKY_PROGRAM_HEADER.size:NO_JERKY_PROGRAM_HEADER.size + body_size]
+    if len(body) != body_size or zlib.crc32(body) != crc:
+        raise ValueError('corrupted motion program')
+
+    symbol_base = n_segments * n_axes * NO_JERKY_PROGRAM_SEGMENT.size
+    symbols = struct.unpack_from(f'<{n_symbols}I', body, symbol_base)
+
+    segments = []
+    for i in range(n_segments):
+        segment = []
+        for axis in range(n_axes):
+            offset, n = NO_JERKY_PROGRAM_SEGMENT.unpack_from(body, (i * n_axes + axis) * NO_JERKY_PROGRAM_SEGMENT.size)
+            if offset + n > n_symbols:
+                raise ValueError(f'segment {i} axis {axis} is out of range')
+            segment.append(list(symbols[offset:offset + n]))
+        segments.append(segment)
+
+    return segments
 
 
 if __name__ == '__main__':
     # mjt_symbolic_coefficients()
     # plot_unit_mjt_profiles()
     # max_velocity_to_trajectory_duration_equations()
-    gen_timestep_array_headers()
+    # time step LUT: see gen_timestep_lut.py (run by the component build)
     plt.show()
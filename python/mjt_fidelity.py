@@ -0,0 +1,235 @@
+"""Trajectory fidelity check of an emitted step stream against the analytic MJT.
+
+Rebuilds position, velocity, acceleration and jerk from a step stream and compares them with the
+minimum jerk trajectory defined by the boundary conditions, so that generator/encoder optimisations
+can be gated on fidelity thresholds. The step count is always checked: ceil((xT - x0)/dx) steps are expected.
+
+Step stream inputs:
+    --dt-file      time steps [us], one per line (or comma separated) e.g. a host build dump of mjt_data_t.dt_array.
+                   Step k lands at the end of its time step.
+    --program      motion program (see src/core/no_jerky_program.h), --segment/--axis select the RMT symbol stream.
+                   Each time step is rebuilt from the symbols of its STEP pulse (rising edge to rising edge) and step k
+                   lands at its end, same as --dt-file. The encoder halves every time step and drops the odd us, up to
+                   that quantisation is restored (see program_step_times) and reported as encoder_dropped_us.
+
+Every fidelity gate has a default threshold, a regression fails without extra flags (exit code 1).
+
+Example:
+    python mjt_fidelity.py --dt-file dt_array.txt --xT 2000 --T 1 --dx 1
+    python mjt_fidelity.py --program move.bin --xT 2000 --T 1 --dx 1
+"""
+import argparse
+import math
+import sys
+
+
+def mjt_coefficients(x0, xT, v0, vT, a0, aT, T):
+    """Same as compute_mjt_coeff() in mjt.c"""
+    c0 = x0
+    c1 = v0
+    c2 = a0/2
+    c3 = (-3*T*T*a0 + T*T*aT - 12*T*v0 - 8*T*vT - 20*x0 + 20*xT)/(2*T*T*T)
+    c4 = (3*T*T*a0 - 2*T*T*aT + 16*T*v0 + 14*T*vT + 30*x0 - 30*xT)/(2*T*T*T*T)
+    c5 = (-T*T*a0 + T*T*aT - 6*T*v0 - 6*T*vT - 12*x0 + 12*xT)/(2*T*T*T*T*T)
+    return c0, c1, c2, c3, c4, c5
+
+
+def mjt_derivatives(c, t):
+    """x, v, a, j of the MJT at time t"""
+    c0, c1, c2, c3, c4, c5 = c
+    x = c0 + t*(c1 + t*(c2 + t*(c3 + t*(c4 + t*c5))))
+    v = c1 + t*(2*c2 + t*(3*c3 + t*(4*c4 + t*5*c5)))
+    a = 2*c2 + t*(6*c3 + t*(12*c4 + t*20*c5))
+    j = 6*c3 + t*(24*c4 + t*60*c5)
+    return x, v, a, j
+
+
+def analytic_step_times(c, n_steps, dx, T):
+    """Time at which the MJT covers each step k*dx (capped at the end of the move), by bisection."""
+    distance = mjt_derivatives(c, T)[0] - c[0]
+    times = []
+    t_low = 0.0
+
+    for k in range(1, n_steps + 1):
+        x_target = min(k * dx, distance)
+        low, high = t_low, T
+        for _ in range(48):
+            mid = 0.5 * (low + high)
+            if mjt_derivatives(c, mid)[0] - c[0] >= x_target:
+                high = mid
+            else:
+                low = mid
+        times.append(high)
+        t_low = low
+
+    return times
+
+
+def read_dt_file(path):
+    with open(path) as f:
+        text = f.read().replace(',', ' ')
+    dt_array = [int(v) for v in text.split()]
+    step_times = []
+    t = 0
+    for dt in dt_array:
+        t += dt
+        step_times.append(t * 1e-6)
+    return step_times, t * 1e-6
+
+
+def read_program_steps(path, segment, axis):
+    """Steps of one axis of a motion program, rebuilt from its RMT symbols.
+
+    Returns the idle time [us] before the first STEP pulse and one (duration, quantisation) pair [us] per step: a step
+    runs from its rising edge to the next one. The encoder halves every time step (split ones in 2^n equal symbols),
+    so a step whose halves are all equal may have lost up to quantisation = 2 * words - 1 us, e.g. the odd us.
+    """
+    from mjt_calculations import read_motion_program   # only needed for programs
+
+    symbols = read_motion_program(path)[segment][axis]
+    lead = 0
+    steps = []
+    level = 0
+    for word in symbols:
+        halves = ((word & 0x7FFF, (word >> 15) & 1), ((word >> 16) & 0x7FFF, (word >> 31) & 1))
+        for duration, new_level in halves:
+            if new_level == 1 and level == 0:
+                steps.append({'duration': 0, 'halves': set(), 'words': 0})
+            level = new_level
+            if steps:
+                steps[-1]['duration'] += duration
+                steps[-1]['halves'].add(duration)
+            else:
+                lead += duration
+        if steps:
+            steps[-1]['words'] += 1
+
+    return lead, [(step['duration'], 2 * step['words'] - 1 if len(step['halves']) == 1 else 0) for step in steps]
+
+
+def program_step_times(lead, steps, analytic):
+    """Step times [s] of a program with the encoder convention: a step lands at the end of its time step, the time
+    step being the symbol duration plus the part the encoder dropped (0..quantisation us, taken closest to the
+    analytic step time). Returns the step times, the stream duration [s] and the total time the encoder dropped [us]."""
+    step_times = []
+    t = lead
+    dropped = 0
+    for (duration, quantisation), ta in zip(steps, analytic):
+        r = min(max(round(ta * 1e6 - (t + duration)), 0), quantisation)
+        t += duration + r
+        dropped += r
+        step_times.append(t * 1e-6)
+    return step_times, t * 1e-6, dropped
+
+
+def fidelity_report(step_times, duration, c, dx, T, window=16):
+    """Compare the step stream with the analytic trajectory."""
+    n = len(step_times)
+    analytic = analytic_step_times(c, n, dx, T)
+
+    time_errors = [abs(t - ta) for t, ta in zip(step_times, analytic)]
+
+    # reconstructed velocity, acceleration and jerk by central differences over +-window steps,
+    # step times are quantised to 1 us so a single step difference is mostly quantisation noise
+    def derivative(times, values):
+        out_times, out = [], []
+        for i in range(window, len(values) - window):
+            span = times[i + window] - times[i - window]
+            if span > 0:
+                out_times.append(times[i])
+                out.append((values[i + window] - values[i - window]) / span)
+        return out_times, out
+
+    positions = [k * dx for k in range(1, n + 1)]
+    vel_times, velocities = derivative(step_times, positions)
+    acc_times, accelerations = derivative(vel_times, velocities)
+    _, jerks = derivative(acc_times, accelerations)
+
+    # the generators emit one step per dx, the last one capped at the end of the move
+    distance = mjt_derivatives(c, T)[0] - c[0]
+    expected_n_steps = math.ceil(distance / dx - 1e-9) if distance > 0 else 0
+
+    samples = [T * i / 1000 for i in range(1001)]
+    analytic_peaks = [max(abs(mjt_derivatives(c, t)[k]) for t in samples) for k in (1, 2, 3)]
+    reconstructed_peaks = [max((abs(v) for v in values), default=0.0) for values in (velocities, accelerations, jerks)]
+
+    if analytic_peaks[0] > 0:
+        peak_velocity_error_pct = 100 * (reconstructed_peaks[0] - analytic_peaks[0]) / analytic_peaks[0]
+    else:
+        peak_velocity_error_pct = math.inf if reconstructed_peaks[0] > 0 else 0.0   # no motion expected
+
+    return {
+        'n_steps': n,
+        'expected_n_steps': expected_n_steps,
+        'step_count_error': n - expected_n_steps,
+        'max_time_error_us': max(time_errors, default=0.0) * 1e6,
+        'rms_time_error_us': math.sqrt(sum(e*e for e in time_errors) / n) * 1e6 if n else 0.0,
+        'peak_velocity': reconstructed_peaks[0],
+        'analytic_peak_velocity': analytic_peaks[0],
+        'peak_velocity_error_pct': peak_velocity_error_pct,
+        'peak_acceleration': reconstructed_peaks[1],
+        'analytic_peak_acceleration': analytic_peaks[1],
+        'peak_jerk': reconstructed_peaks[2],
+        'analytic_peak_jerk': analytic_peaks[2],
+        'duration_error_us': (duration - T) * 1e6,
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Check a step stream against the analytic MJT.')
+    source = parser.add_mutually_exclusive_group(required=True)
+    source.add_argument('--dt-file', help='time steps [us] of the move')
+    source.add_argument('--program', help='motion program file')
+    parser.add_argument('--segment', type=int, default=0, help='program segment')
+    parser.add_argument('--axis', type=int, default=0, help='program axis')
+
+    parser.add_argument('--x0', type=float, default=0)
+    parser.add_argument('--xT', type=float, required=True)
+    parser.add_argument('--v0', type=float, default=0)
+    parser.add_argument('--vT', type=float, default=0)
+    parser.add_argument('--a0', type=float, default=0)
+    parser.add_argument('--aT', type=float, default=0)
+    parser.add_argument('--T', type=float, required=True, help='trajectory duration [s]')
+    parser.add_argument('--dx', type=float, required=True, help='step size')
+    parser.add_argument('--window', type=int, default=16, help='steps on each side of the derivative reconstruction')
+
+    # fidelity gates, the defaults hold for the LUT generator (2 us resolution) and the RMT encoder, < 0 disables one
+    parser.add_argument('--step-count-error', type=int, default=0, help='steps missing or extra, ceil((xT - x0)/dx) expected')
+    parser.add_argument('--max-time-error-us', type=float, default=5)
+    parser.add_argument('--rms-time-error-us', type=float, default=2)
+    parser.add_argument('--peak-velocity-error-pct', type=float, default=5)
+    parser.add_argument('--duration-error-us', type=float, default=5)
+    args = parser.parse_args()
+
+    c = mjt_coefficients(args.x0, args.xT, args.v0, args.vT, args.a0, args.aT, args.T)
+
+    if args.dt_file:
+        step_times, duration = read_dt_file(args.dt_file)
+        dropped = None
+    else:
+        lead, steps = read_program_steps(args.program, args.segment, args.axis)
+        analytic = analytic_step_times(c, len(steps), args.dx, args.T)
+        step_times, duration, dropped = program_step_times(lead, steps, analytic)
+
+    report = fidelity_report(step_times, duration, c, args.dx, args.T, args.window)
+    if dropped is not None:
+        report['encoder_dropped_us'] = dropped    # halving quantisation of the symbols, reported only
+
+    for key, value in report.items():
+        print(f'{key:>28}: {value:.6g}')
+
+    gates = [('step_count_error', args.step_count_error),
+             ('max_time_error_us', args.max_time_error_us),
+             ('rms_time_error_us', args.rms_time_error_us),
+             ('peak_velocity_error_pct', args.peak_velocity_error_pct),
+             ('duration_error_us', args.duration_error_us)]
+    failed = [key for key, limit in gates if limit >= 0 and abs(report[key]) > limit]
+
+    for key in failed:
+        print(f'FAIL: {key} exceeds its threshold')
+
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,122 @@
+#include <stddef.h>
+
+#include "no_jerky_program.h"
+
+
+// static functions
+static uint32_t no_jerky_crc32(const uint8_t* data, uint32_t size);
+
+
+/**
+ * @brief Validate a motion program and set up views into it. The data is used in place, e.g. a memory-mapped flash partition.
+ *
+ * @param data program data, 4-byte aligned
+ * @param size [bytes] size of the data, can be larger than the program (e.g. the whole partition)
+ * @param program [out] views into the program
+ * @return no_jerky_program_err_t
+ */
+no_jerky_program_err_t open_no_jerky_program(const void* data, uint32_t size, no_jerky_program_t* program)
+{
+    const no_jerky_program_header_t* header = (const no_jerky_program_header_t*) data;
+
+    if (size < sizeof(no_jerky_program_header_t))
+    {
+        return NO_JERKY_PROGRAM_ERR_SIZE;
+    }
+
+    if (header->magic != NO_JERKY_PROGRAM_MAGIC)
+    {
+        return NO_JERKY_PROGRAM_ERR_MAGIC;
+    }
+
+    if (header->version != NO_JERKY_PROGRAM_VERSION)
+    {
+        return NO_JERKY_PROGRAM_ERR_VERSION;
+    }
+
+    uint32_t program_size = no_jerky_program_size(header);
+    if (program_size == 0 || size < program_size)
+    {
+        return NO_JERKY_PROGRAM_ERR_SIZE;
+    }
+
+    const uint8_t* body = (const uint8_t*) data + sizeof(no_jerky_program_header_t);
+    if (no_jerky_crc32(body, program_size - sizeof(no_jerky_program_header_t)) != header->crc32)
+    {
+        return NO_JERKY_PROGRAM_ERR_CRC;
+    }
+
+    program->header = header;
+    program->segments = (const no_jerky_program_segment_t*) body;
+    program->symbols = (const uint32_t*) (body + (size_t) header->n_segments * header->n_axes * sizeof(no_jerky_program_segment_t));
+
+    // every axis of every segment must stay within the symbols
+    for (uint32_t i = 0; i < header->n_segments * header->n_axes; i++)
+    {
+        const no_jerky_program_segment_t* segment = &program->segments[i];
+
+        if (segment->symbol_offset > header->n_symbols || segment->n_symbols > header->n_symbols - segment->symbol_offset)
+        {
+            return NO_JERKY_PROGRAM_ERR_SEGMENT;
+        }
+    }
+
+    return NO_JERKY_PROGRAM_OK;
+}
+
+
+/**
+ * @brief Symbols of one axis in one segment, as raw rmt_symbol_word_t values.
+ *
+ * @param program opened program
+ * @param segment segment index
+ * @param axis axis index
+ * @param n_symbols [out] number of symbols, 0 if the axis is idle in this segment
+ * @return const uint32_t*
+ */
+const uint32_t* get_no_jerky_program_symbols(const no_jerky_program_t* program, uint32_t segment, uint8_t axis, uint32_t* n_symbols)
+{
+    const no_jerky_program_segment_t* s = &program->segments[segment * program->header->n_axes + axis];
+
+    *n_symbols = s->n_symbols;
+    return &program->symbols[s->symbol_offset];
+}
+
+
+/**
+ * @brief Size [bytes] of the program described by the header, 0 if the header is inconsistent.
+ */
+uint32_t no_jerky_program_size(const no_jerky_program_header_t* header)
+{
+    uint64_t size = sizeof(no_jerky_program_header_t) +
+                    (uint64_t) header->n_segments * header->n_axes * sizeof(no_jerky_program_segment_t) +
+                    (uint64_t) header->n_symbols * sizeof(uint32_t);
+
+    if (size > UINT32_MAX)
+    {
+        return 0;
+    }
+
+    return (uint32_t) size;
+}
+
+
+/**
+ * @brief CRC-32 (reflected, polynomial 0xEDB88320), same as zlib.crc32() in python.
+ */
+static uint32_t no_jerky_crc32(const uint8_t* data, uint32_t size)
+{
+    uint32_t crc = 0xFFFFFFFF;
+
+    for (uint32_t i = 0; i < size; i++)
+    {
+        crc ^= data[i];
+
+        for (uint8_t k = 0; k < 8; k++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+
+    return ~crc;
+}
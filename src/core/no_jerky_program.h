@@ -0,0 +1,75 @@
+/**
+ * @file no_jerky_program.h
+ * @brief Binary format of precomputed multi-axis motion programs (per-axis RMT symbol streams + sync markers).
+ *        Platform independent so that the same programs can be read by host tools before they are flashed.
+ *
+ * Layout (little endian, 4-byte aligned):
+ *      no_jerky_program_header_t
+ *      no_jerky_program_segment_t [n_segments * n_axes]    segment major, i.e. [segment][axis]
+ *      uint32_t symbols[]                                  raw rmt_symbol_word_t values
+ *
+ * Every segment ends with a sync marker: all axes finish the segment before any axis starts the next one.
+ * See python/mjt_calculations.py write_motion_program() for the writer.
+ */
+#ifndef NO_JERKY_PROGRAM_H
+#define NO_JERKY_PROGRAM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+
+#define NO_JERKY_PROGRAM_MAGIC 0x504D4A4E    // "NJMP"
+#define NO_JERKY_PROGRAM_VERSION 1
+
+
+typedef struct no_jerky_program_header
+{
+    uint32_t magic;         // NO_JERKY_PROGRAM_MAGIC
+    uint16_t version;       // NO_JERKY_PROGRAM_VERSION
+    uint8_t n_axes;         // number of axes
+    uint8_t reserved;
+    uint32_t n_segments;    // number of segments, each one ends with a sync marker
+    uint32_t n_symbols;     // total number of symbols of all axes
+    uint32_t crc32;         // CRC-32 (zlib) of everything after the header
+} no_jerky_program_header_t;
+
+
+typedef struct no_jerky_program_segment
+{
+    uint32_t symbol_offset; // index of the first symbol of the axis in this segment
+    uint32_t n_symbols;     // number of symbols of the axis in this segment, 0 if the axis is idle
+} no_jerky_program_segment_t;
+
+
+typedef enum no_jerky_program_err
+{
+    NO_JERKY_PROGRAM_OK = 0,
+    NO_JERKY_PROGRAM_ERR_SIZE,      // data too small for the header, the tables or the symbols
+    NO_JERKY_PROGRAM_ERR_MAGIC,     // not a motion program
+    NO_JERKY_PROGRAM_ERR_VERSION,   // unsupported version
+    NO_JERKY_PROGRAM_ERR_CRC,       // corrupted program
+    NO_JERKY_PROGRAM_ERR_SEGMENT,   // segment table points outside of the symbols
+} no_jerky_program_err_t;
+
+
+typedef struct no_jerky_program
+{
+    // views into the program data, nothing is copied
+    const no_jerky_program_header_t* header;
+    const no_jerky_program_segment_t* segments;
+    const uint32_t* symbols;
+} no_jerky_program_t;
+
+
+no_jerky_program_err_t open_no_jerky_program(const void* data, uint32_t size, no_jerky_program_t* program);
+const uint32_t* get_no_jerky_program_symbols(const no_jerky_program_t* program, uint32_t segment, uint8_t axis, uint32_t* n_symbols);
+uint32_t no_jerky_program_size(const no_jerky_program_header_t* header);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // NO_JERKY_PROGRAM_H
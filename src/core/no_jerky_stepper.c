@@ -1,14 +1,40 @@
 #include "no_jerky_stepper.h"
 
 
+// static functions
+static no_jerky_stepper_t init_not_jerky_stepper(no_jerky_output_t output_ch, no_jerky_motor_pins_t motor_pins, uint8_t motor_id, const char* motor_group);
+
+
 no_jerky_stepper_t create_a_not_jerky_stepper(no_jerky_motor_pins_t motor_pins, uint8_t motor_id, const char* motor_group)
+{
+    return init_not_jerky_stepper(no_jerky_init(motor_pins), motor_pins, motor_id, motor_group);
+}
+
+
+no_jerky_stepper_t create_a_not_jerky_stepper_with_dir_channel(no_jerky_motor_pins_t motor_pins, uint8_t motor_id, const char* motor_group)
+{
+    return init_not_jerky_stepper(no_jerky_init_with_dir_channel(motor_pins), motor_pins, motor_id, motor_group);
+}
+
+
+/**
+ * @brief Set up a stepper around an initialised output channel.
+ */
+static no_jerky_stepper_t init_not_jerky_stepper(no_jerky_output_t output_ch, no_jerky_motor_pins_t motor_pins, uint8_t motor_id, const char* motor_group)
 {
     no_jerky_stepper_t stepper;
-    stepper.output_ch = no_jerky_init(motor_pins);
+    stepper.output_ch = output_ch;
     stepper.pins = motor_pins;
     stepper.motor_id = motor_id;
     stepper.motor_group = motor_group;
-    
+
     stepper.output_not_jerky_motion_curve = &output_not_jerky_motion_curve;
+    stepper.output_not_jerky_symbols = &output_not_jerky_symbols;
+    stepper.output_not_jerky_signed_motion_curve = &output_not_jerky_signed_motion_curve;
+    stepper.output_not_jerky_motion_curve_at = &output_not_jerky_motion_curve_at;
+    stepper.cancel_not_jerky_motion_curve_at = &cancel_not_jerky_motion_curve_at;
+    stepper.output_not_jerky_move = &output_not_jerky_move;
+    stepper.get_not_jerky_motion_snapshot = &get_not_jerky_motion_snapshot;
+    stepper.set_not_jerky_feed_rate = &set_not_jerky_feed_rate;
     return stepper;
-}
\ No newline at end of file
+}
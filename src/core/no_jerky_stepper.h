@@ -16,11 +16,19 @@ typedef struct no_jerky_stepper
 
     // functions
     void (*output_not_jerky_motion_curve)(no_jerky_output_t, uint32_t*, uint32_t);
+    void (*output_not_jerky_symbols)(no_jerky_output_t, const rmt_symbol_word_t*, uint32_t);
+    void (*output_not_jerky_signed_motion_curve)(no_jerky_output_t, uint32_t*, uint32_t, int8_t);
+    esp_err_t (*output_not_jerky_motion_curve_at)(no_jerky_output_t, uint32_t*, uint32_t, int64_t);
+    esp_err_t (*cancel_not_jerky_motion_curve_at)(no_jerky_output_t);
+    void (*output_not_jerky_move)(no_jerky_output_t, mjt_data_t*, int8_t);
+    no_jerky_motion_snapshot_t (*get_not_jerky_motion_snapshot)(no_jerky_output_t);
+    void (*set_not_jerky_feed_rate)(no_jerky_output_t, uint16_t);
 
 } no_jerky_stepper_t;
 
 
 no_jerky_stepper_t create_a_not_jerky_stepper(no_jerky_motor_pins_t motor_pins, uint8_t motor_id, const char* motor_group);
+no_jerky_stepper_t create_a_not_jerky_stepper_with_dir_channel(no_jerky_motor_pins_t motor_pins, uint8_t motor_id, const char* motor_group);
 
 
 #ifdef __cplusplus
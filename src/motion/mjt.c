@@ -6,68 +6,103 @@
 #include "mjt.h"
 
 
+// static functions
+static void gen_motion_profile_steps(mjt_data_t* data);
+static void plan_mjt_with_limits(mjt_data_t* data);
+static void plan_mjt_with_time(mjt_data_t* data);
+static uint32_t mjt_engine_steps(mjt_data_t* data, uint32_t n_allocated_pts);
+static double mjt_position(const mjt_data_t* data, double t);
+static void plan_s_curve_with_limits(mjt_data_t* data);
+static void plan_s_curve_with_time(mjt_data_t* data);
+static uint32_t s_curve_steps(mjt_data_t* data, uint32_t n_allocated_pts);
+static double s_curve_profile_position(const mjt_data_t* data, double t);
+static uint32_t lut_search_mjt_steps(mjt_data_t* data, uint32_t n_allocated_pts);
+static uint32_t forward_difference_mjt_steps(mjt_data_t* data, uint32_t n_allocated_pts);
+static void append_mjt_timestep(mjt_data_t* data, uint32_t dt_us, uint32_t* n, uint32_t* n_allocated_pts);
+static double multi_stage_binary_mjt_timestep_search(mjt_data_t* data, double* x_stepped, double* tt);
+static double vector_multi_stage_mjt_timestep_search(mjt_data_t* data, double* x_stepped, double* tt);
+static float expand_mjt_at(const mjt_data_t* data, double tt, double x_stepped, float* d);
+static uint8_t count_mjt_timesteps_below_step(const float* timestep_lut, uint8_t lut_size, const float* d, float tau_base, float remaining);
+static uint8_t mjt_timestep_starting_stage(uint8_t level0_idx);
+static uint8_t binary_mjt_timestep_index_search(uint8_t stage, mjt_data_t* data, double x_stepped, double tt);
+
+
+const motion_profile_t mjt_profile = {
+    .name = "mjt",
+    .plan_with_limits = plan_mjt_with_limits,
+    .plan_with_time = plan_mjt_with_time,
+    .gen_steps = mjt_engine_steps,
+    .position = mjt_position,
+};
+
+
+const motion_profile_t s_curve_profile = {
+    .name = "s-curve",
+    .plan_with_limits = plan_s_curve_with_limits,
+    .plan_with_time = plan_s_curve_with_time,
+    .gen_steps = s_curve_steps,
+    .position = s_curve_profile_position,
+};
+
+
 /**
- * @brief Generate a minimum jerk trajectory with a maximum velocity constraint.
+ * @brief Generate the shortest trajectory within the velocity, acceleration and jerk limits with the selected profile.
  * 
  * @param data [mj_data_t*] pointer to the mjt_data_t struct
  *                 input data:
  *                    - vmax [m/s or deg/s] maximum velocity <- this is more intiuitive than acceleration limit
+ *                    - amax [m/s^2 or deg/s^2] maximum acceleration
+ *                    - jmax [m/s^3 or deg/s^3] maximum jerk
  *                    - dx [m or deg] step size
- *                    - unit_dt [s] smallest time step unit   
+ *                    - profile motion profile, see motion_profile_t
+ *                    - engine step generator engine of mjt_profile, see mjt_engine_t
  * 
  *                 output data:
- *                    - dt_array [us] mjt trajectory represented by varying time steps (one variable time step for each unit step distance)
+ *                    - dt_array [us] trajectory represented by varying time steps (one variable time step for each unit step distance)
  *                    - n number of points of the trajectory
- *                    - bc boundary conditions
- *                    - coeff mjt coefficients  [can be an input as well for non default boundary conditions]
+ *                    - bc.T [s] trajectory duration
+ *                    - coeff mjt coefficients / s_curve S-curve segments, depending on the profile
  */
 void gen_mjt_with_vmax_constraint(mjt_data_t* data)
 {
-    // // calculate a T (trajectory duration) based on vmax
-    // double a = data->bc.xT * 1.875;
-    // data->bc.T = (uint32_t)(a / data->vmax);    // [s] round to the nearest second
-
-
-
-
-
-    // calculate the mjt coefficients
-    data->coeff = compute_mjt_coeff(data->bc);
-
-    // calculate the number of points of the trajectory
-    uint32_t n_allocated_pts = (uint32_t)(data->bc.T / MJT_UNIT_TS);
-
-    if (n_allocated_pts > 1000)
-    {
-        // making sure that the buffer is not too large to start with
-        n_allocated_pts = 1000;
-    }
+    data->profile->plan_with_limits(data);
 
-    // allocate memory for the dt_array
-    data->dt_array = (uint32_t*)malloc(n_allocated_pts * sizeof(uint32_t));
+    gen_motion_profile_steps(data);
 }
 
 
 /**
- * @brief Generate a minimum jerk trajectory with a time constraint.
+ * @brief Generate a trajectory with a time constraint with the selected profile.
  * 
  * @param data [mj_data_t*] pointer to the mjt_data_t struct
  *                 input data:
  *                   - vmax [m/s or deg/s] maximum velocity <- this is more intiuitive than acceleration limit
+ *                   - amax, jmax acceleration and jerk limits of s_curve_profile
  *                   - dx [m or deg] step size
  *                   - unit_dt [s] smallest time step unit
  *                   - bc.T [s] trajectory duration
+ *                   - profile motion profile, see motion_profile_t
+ *                   - engine step generator engine, see mjt_engine_t
+ *                   - dda_tick [s] tick of the forward difference engine
  * 
  *                 output data:
  *                   - dt_array [us] mjt trajectory represented by varying time steps (one variable time step for each unit step distance)
  *                   - n number of points of the trajectory
- *                   - coeff mjt coefficients  
+ *                   - coeff mjt coefficients / s_curve S-curve segments, depending on the profile
  */
 void gen_mjt_with_time_constraint(mjt_data_t* data)
 {
-    // calculate the mjt coefficients
-    data->coeff = compute_mjt_coeff(data->bc);
+    data->profile->plan_with_time(data);
 
+    gen_motion_profile_steps(data);
+}
+
+
+/**
+ * @brief Allocate the dt_array and fill it with the time steps of the planned move.
+ */
+static void gen_motion_profile_steps(mjt_data_t* data)
+{
     // calculate the number of points of the trajectory - start with a small buffer
     uint32_t n_allocated_pts = (uint32_t)(data->bc.T / MJT_UNIT_TS)/10;
 
@@ -76,118 +111,341 @@ void gen_mjt_with_time_constraint(mjt_data_t* data)
         // making sure that the buffer is not too large to start with
         n_allocated_pts = 1000;
     }
+    else if (n_allocated_pts < 16)
+    {
+        // short moves, the buffer is grown by doubling it
+        n_allocated_pts = 16;
+    }
 
     // allocate memory for the dt_array
     data->dt_array = (uint32_t*)malloc(n_allocated_pts * sizeof(uint32_t));
 
-    // generate the mjt trajectory
-    double x = 0;
-    double two_dx = 2 * data->dx;
+    data->n = data->profile->gen_steps(data, n_allocated_pts);
+
+    if (data->n == 0)
+    {
+        // generation failed, realloc() to 0 bytes is implementation defined
+        free(data->dt_array);
+        data->dt_array = NULL;
+        return;
+    }
+
+    // shrink the dt_array to the actual number of points
+    data->dt_array = (uint32_t*)realloc(data->dt_array, data->n * sizeof(uint32_t));
+}
+
+
+/**
+ * @brief Shortest MJT within the limits. Rest to rest, the peaks of the quintic are v = 1.875*xT/T,
+ *        a = 10/sqrt(3)*xT/T^2 and j = 60*xT/T^3.
+ */
+static void plan_mjt_with_limits(mjt_data_t* data)
+{
+    double distance = (double) data->bc.xT - (double) data->bc.x0;
+    double T = 1.875 * distance / data->vmax;
+
+    double T_acc = sqrt(10.0 / sqrt(3.0) * distance / data->amax);
+    double T_jerk = cbrt(60.0 * distance / data->jmax);
+
+    T = (T_acc > T) ? T_acc : T;
+    T = (T_jerk > T) ? T_jerk : T;
+
+    data->bc.T = T;
+    data->coeff = compute_mjt_coeff(data->bc);
+}
+
+
+static void plan_mjt_with_time(mjt_data_t* data)
+{
+    // calculate the mjt coefficients
+    data->coeff = compute_mjt_coeff(data->bc);
+}
+
+
+/**
+ * @brief Generate the MJT time steps with the selected engine.
+ */
+static uint32_t mjt_engine_steps(mjt_data_t* data, uint32_t n_allocated_pts)
+{
+    switch (data->engine)
+    {
+        case MJT_ENGINE_FORWARD_DIFFERENCE:
+            return forward_difference_mjt_steps(data, n_allocated_pts);
+        case MJT_ENGINE_LUT_SEARCH:
+        case MJT_ENGINE_LUT_VECTOR_SEARCH:
+        default:
+            return lut_search_mjt_steps(data, n_allocated_pts);
+    }
+}
+
+
+static double mjt_position(const mjt_data_t* data, double t)
+{
+    const mjt_coeff_t c = data->coeff;
+
+    return t*(c.c1 + t*(c.c2 + t*(c.c3 + t*(c.c4 + t*c.c5))));
+}
+
+
+static void plan_s_curve_with_limits(mjt_data_t* data)
+{
+    plan_s_curve(&data->s_curve, (double) data->bc.xT - (double) data->bc.x0, data->vmax, data->amax, data->jmax);
+    data->bc.T = data->s_curve.T;
+}
+
+
+static void plan_s_curve_with_time(mjt_data_t* data)
+{
+    plan_s_curve_with_duration(&data->s_curve, (double) data->bc.xT - (double) data->bc.x0, data->bc.T, data->amax, data->jmax);
+    data->bc.T = data->s_curve.T;
+}
+
+
+/**
+ * @brief Generate the S-curve time steps: each step lands at the closed form time at which the S-curve covers it,
+ *        no search. Step edges are rounded to us in absolute time so that the rounding does not accumulate.
+ *        Time steps are S_CURVE_MIN_DT_US at least (limits above 500k steps/s): a shorter one is stretched and the
+ *        later edges catch up with the profile once it is slower than that.
+ */
+static uint32_t s_curve_steps(mjt_data_t* data, uint32_t n_allocated_pts)
+{
+    const s_curve_t* s = &data->s_curve;
+    uint32_t n = 0;
+    double x_stepped = 0;
+    uint32_t last_step_us = 0;
+    uint32_t n_stretched = 0;
+
+    while (x_stepped < s->distance)
+    {
+        x_stepped += data->dx;
+
+        double x = (x_stepped < s->distance) ? x_stepped : s->distance;
+        uint32_t step_us = (uint32_t) round(s_curve_time_at_position(s, x) * 1000000.0);  // convert to us
+
+        if (step_us < last_step_us + S_CURVE_MIN_DT_US)
+        {
+            step_us = last_step_us + S_CURVE_MIN_DT_US;
+            n_stretched++;
+        }
+
+        append_mjt_timestep(data, step_us - last_step_us, &n, &n_allocated_pts);
+        last_step_us = step_us;
+    }
+
+    if (n_stretched > 0)
+    {
+        printf("s-curve: %u time steps stretched to %u us, the limits exceed the step rate\n", (unsigned) n_stretched, S_CURVE_MIN_DT_US);
+    }
+
+    return n;
+}
+
+
+static double s_curve_profile_position(const mjt_data_t* data, double t)
+{
+    return s_curve_position(&data->s_curve, t);
+}
+
+
+/**
+ * @brief Generate the dt_array by searching the timestep LUT for every step.
+ * 
+ * @param data [mj_data_t*] pointer to the mjt_data_t struct, coeff must be computed and dt_array allocated
+ * @param n_allocated_pts number of points allocated in dt_array
+ * @return uint32_t number of points of the trajectory
+ */
+static uint32_t lut_search_mjt_steps(mjt_data_t* data, uint32_t n_allocated_pts)
+{
     uint32_t n = 0;
     double x_stepped = 0;   // x_stepped is the distance covered by the trajectory
     double tt = 0;  // total time in increments of unit_dt
 
+    double (*timestep_search)(mjt_data_t*, double*, double*) = multi_stage_binary_mjt_timestep_search;
+
+    if (data->engine == MJT_ENGINE_LUT_VECTOR_SEARCH)
+    {
+        timestep_search = vector_multi_stage_mjt_timestep_search;
+    }
+
     while (1)
     {
-        double ts = multi_stage_binary_mjt_timestep_search(data, &x_stepped, &tt);
+        double ts = timestep_search(data, &x_stepped, &tt);
 
-        data->dt_array[n] = round(ts * 1000000.0);   // convert to us
+        append_mjt_timestep(data, round(ts * 1000000.0), &n, &n_allocated_pts);   // convert to us
 
-        n++;
-        if (n >= n_allocated_pts)
+        if (x_stepped >= data->bc.xT)
         {
-            n_allocated_pts *= 2;
-            data->dt_array = (uint32_t*)realloc(data->dt_array, n_allocated_pts * sizeof(uint32_t));
+            break;
         }
+    }
 
-        if (x_stepped >= data->bc.xT)
+    return n;
+}
+
+
+/**
+ * @brief Generate the dt_array with a fixed tick DDA.
+ *        The quintic is advanced by its 5th order forward differences (additions only per tick),
+ *        a step is emitted whenever the position crosses the next dx boundary and its timestep is
+ *        the number of ticks since the previous step.
+ * 
+ *        The tick must be shorter than the shortest step interval: a tick that crosses more than one step fails.
+ * 
+ * @param data [mj_data_t*] pointer to the mjt_data_t struct, coeff must be computed and dt_array allocated
+ * @param n_allocated_pts number of points allocated in dt_array
+ * @return uint32_t number of points of the trajectory, 0 if dda_tick is invalid or too long for the move
+ */
+static uint32_t forward_difference_mjt_steps(mjt_data_t* data, uint32_t n_allocated_pts)
+{
+    if (!(data->dda_tick > 0) || data->bc.T / data->dda_tick >= UINT32_MAX)
+    {
+        printf("forward difference mjt: invalid dda_tick %g s\n", data->dda_tick);
+        return 0;
+    }
+
+    const mjt_coeff_t c = data->coeff;
+    const double h = data->dda_tick;
+    const double h2 = h*h;
+    const double h3 = h2*h;
+    const double h4 = h3*h;
+    const double h5 = h4*h;
+
+    // forward differences of the quintic at t=0: d_k = sum_n c_n * h^n * k! * S(n,k), S = Stirling numbers of the 2nd kind
+    // x is the distance from c0, so that it can be compared against x_stepped directly
+    double x = 0;
+    double d1 = c.c1*h + c.c2*h2 + c.c3*h3 + c.c4*h4 + c.c5*h5;
+    double d2 = 2.0*(c.c2*h2 + 3.0*c.c3*h3 + 7.0*c.c4*h4 + 15.0*c.c5*h5);
+    double d3 = 6.0*(c.c3*h3 + 6.0*c.c4*h4 + 25.0*c.c5*h5);
+    double d4 = 24.0*(c.c4*h4 + 10.0*c.c5*h5);
+    double d5 = 120.0*c.c5*h5;
+
+    uint32_t n = 0;
+    double x_stepped = 0;
+    uint32_t n_ticks = (uint32_t) round(data->bc.T / h);
+    uint32_t last_step_us = 0;  // step edges are rounded to us in absolute time so that the rounding does not accumulate
+
+    for (uint32_t tick = 1; tick <= n_ticks; tick++)
+    {
+        x += d1;
+        d1 += d2;
+        d2 += d3;
+        d3 += d4;
+        d4 += d5;
+
+        while (x - x_stepped >= data->dx)
         {
-            break;
+            uint32_t step_us = (uint32_t) round(tick * h * 1000000.0);  // convert to us
+            if (step_us == last_step_us)
+            {
+                // more than one step per tick (or per us) would be a zero interval, the tick is too long for this move
+                printf("forward difference mjt: more than one step per tick, bad step size or tick selection?\n");
+                return 0;
+            }
+
+            append_mjt_timestep(data, step_us - last_step_us, &n, &n_allocated_pts);
+            last_step_us = step_us;
+            x_stepped += data->dx;
         }
     }
 
-    data->n = n;
+    // x(T) = xT analytically, flush the steps lost to rounding at the end of the trajectory
+    while (x_stepped < data->bc.xT)
+    {
+        uint32_t step_us = (uint32_t) round(n_ticks * h * 1000000.0);
+        if (step_us == last_step_us)
+        {
+            printf("forward difference mjt: more than one step per tick, bad step size or tick selection?\n");
+            return 0;
+        }
 
-    // shrink the dt_array to the actual number of points
-    data->dt_array = (uint32_t*)realloc(data->dt_array, n * sizeof(uint32_t));
+        append_mjt_timestep(data, step_us - last_step_us, &n, &n_allocated_pts);
+        last_step_us = step_us;
+        x_stepped += data->dx;
+    }
+
+    return n;
+}
+
+
+/**
+ * @brief Append one timestep to the dt_array, growing the buffer when it is full.
+ */
+static void append_mjt_timestep(mjt_data_t* data, uint32_t dt_us, uint32_t* n, uint32_t* n_allocated_pts)
+{
+    data->dt_array[*n] = dt_us;
+
+    (*n)++;
+    if (*n >= *n_allocated_pts)
+    {
+        *n_allocated_pts *= 2;
+        data->dt_array = (uint32_t*)realloc(data->dt_array, *n_allocated_pts * sizeof(uint32_t));
+    }
 }
 
 
+/**
+ * @brief Time step to the next step: level 0 selects the starting level from the magnitude of the time step, then each
+ *        level adds its largest candidate (one digit in base MJT_TS_LUT_BRANCHING) that stays below the step.
+ *        Intervals longer than the LUT advance by its largest level 0 candidate first.
+ */
 static double multi_stage_binary_mjt_timestep_search(mjt_data_t* data, double* x_stepped, double* tt)
 {
     const double* ts_lut = NULL;
     double final_ts = 0;
     uint8_t starting_stage = 0;
+    uint8_t reached = 0;
 
-    // check stage 0 to determine the starting search stage
-    double x = 0;
-    for (uint8_t i=0; i < TS_LUT_LEVEL0_SIZE; i++)
+    while (1)
     {
-        // calculate current position
-        double ts = ts_lut_level0[i];
-
-        double udt2 = (*tt+ts)*(*tt+ts);
-        double udt3 = udt2*(*tt+ts);
-        double udt4 = udt3*(*tt+ts);
-        double udt5 = udt4*(*tt+ts);
-
-        x = (double) data->coeff.c0 + 
-                     data->coeff.c1*(*tt+ts) + 
-                     data->coeff.c2*udt2 + 
-                     data->coeff.c3*udt3 + 
-                     data->coeff.c4*udt4 + 
-                     data->coeff.c5*udt5;
-
-        if (x - *x_stepped >= data->dx)
+        // check stage 0 to determine the starting search stage
+        double x = 0;
+        for (uint8_t i=0; i < TS_LUT_LEVEL0_SIZE; i++)
         {
-            if (i == 0)
-            {
-                // this should not be possible??
-                printf("multi stage binary search failed: need to start with ts=2e-6, bad step size selection?\n");
-                break;
-            }
-            else
+            // calculate current position
+            double ts = ts_lut_level0[i];
+
+            double udt2 = (*tt+ts)*(*tt+ts);
+            double udt3 = udt2*(*tt+ts);
+            double udt4 = udt3*(*tt+ts);
+            double udt5 = udt4*(*tt+ts);
+
+            x = (double) data->coeff.c0 + 
+                         data->coeff.c1*(*tt+ts) + 
+                         data->coeff.c2*udt2 + 
+                         data->coeff.c3*udt3 + 
+                         data->coeff.c4*udt4 + 
+                         data->coeff.c5*udt5;
+
+            if (x - *x_stepped >= data->dx)
             {
-                starting_stage = 6 - i + 1;
+                reached = 1;
+                starting_stage = mjt_timestep_starting_stage(i);
                 break;
             }
         }
+
+        if (reached || *tt >= data->bc.T)
+        {
+            break;
+        }
+
+        // interval longer than the LUT
+        final_ts += ts_lut_level0[TS_LUT_LEVEL0_SIZE - 1];
+        *tt += ts_lut_level0[TS_LUT_LEVEL0_SIZE - 1];
     }
 
     if (starting_stage == 0)
     {
-        // this should not be possible as well :(
+        // this should not be possible :( bad step size selection?
         printf("multi stage binary search failed: no suitable timestep found\n");
-        final_ts = ts_lut_level0[0];
-        *tt += ts_lut_level0[0];
+        final_ts += MJT_UNIT_TS;
+        *tt += MJT_UNIT_TS;
     }
     else
     {
-        for (uint8_t stage = starting_stage; stage <= 6; stage++)
+        for (uint8_t stage = starting_stage; stage <= MJT_TS_LUT_N_LEVELS; stage++)
         {
-            switch (stage)
-            {
-                case 1:
-                    ts_lut = ts_lut_level1;
-                    break;
-                case 2:
-                    ts_lut = ts_lut_level2;
-                    break;
-                case 3:
-                    ts_lut = ts_lut_level3;
-                    break;
-                case 4:
-                    ts_lut = ts_lut_level4;
-                    break;
-                case 5:
-                    ts_lut = ts_lut_level5;
-                    break;
-                case 6:
-                    ts_lut = ts_lut_level6;
-                    break;
-                default:
-                    printf("multi stage binary search not possible to be here 1\n");    // invalid stage
-            }
+            ts_lut = ts_lut_levels[stage];
 
             uint8_t idx = binary_mjt_timestep_index_search(stage, data, *x_stepped, *tt);
 
@@ -209,46 +467,143 @@ static double multi_stage_binary_mjt_timestep_search(mjt_data_t* data, double* x
 }
 
 
+/**
+ * @brief Same candidates and result as multi_stage_binary_mjt_timestep_search, but each level is counted in one
+ *        branchless pass over all its candidates instead of a binary search. The quintic is expanded once per step
+ *        around tt in double (x(tt + tau) - x(tt) = tau*(d1 + tau*(d2 + ...))), the candidates are then evaluated in
+ *        float: the ESP32-S3 FPU is single precision (double is emulated), the fixed trip loops can be vectorised
+ *        by the compiler on hosts. PIE SIMD is integer only and is not used.
+ */
+static double vector_multi_stage_mjt_timestep_search(mjt_data_t* data, double* x_stepped, double* tt)
+{
+    float d[5];
+    float remaining = 0;
+    double final_ts = 0;
+    uint8_t starting_stage = 0;
+
+    while (1)
+    {
+        remaining = expand_mjt_at(data, *tt, *x_stepped, d);
+
+        // check stage 0 to determine the starting search stage
+        uint8_t n_below = count_mjt_timesteps_below_step(ts_lut_level0_f32, TS_LUT_LEVEL0_SIZE, d, 0, remaining);
+
+        if (n_below < TS_LUT_LEVEL0_SIZE)
+        {
+            starting_stage = mjt_timestep_starting_stage(n_below);
+            break;
+        }
+
+        if (*tt >= data->bc.T)
+        {
+            break;
+        }
+
+        // interval longer than the LUT
+        final_ts += ts_lut_level0[TS_LUT_LEVEL0_SIZE - 1];
+        *tt += ts_lut_level0[TS_LUT_LEVEL0_SIZE - 1];
+    }
+
+    if (starting_stage == 0)
+    {
+        printf("multi stage vector search failed: no suitable timestep found\n");
+        final_ts += MJT_UNIT_TS;
+        *tt += MJT_UNIT_TS;
+    }
+    else
+    {
+        double step_ts = 0;     // kept in double, tau only offsets the float candidates
+        float tau = 0;
+
+        for (uint8_t stage = starting_stage; stage <= MJT_TS_LUT_N_LEVELS; stage++)
+        {
+            uint8_t n_below = count_mjt_timesteps_below_step(ts_lut_levels_f32[stage], ts_lut_level_sizes[stage], d, tau, remaining);
+
+            if (n_below > 0)
+            {
+                step_ts += ts_lut_levels[stage][n_below - 1];
+                tau += ts_lut_levels_f32[stage][n_below - 1];
+            }
+        }
+
+        final_ts += step_ts;
+        *tt += step_ts;
+    }
+
+    *x_stepped += data->dx;
+
+    return final_ts;
+}
+
+
+/**
+ * @brief Taylor coefficients d[0..4] of the quintic around tt, in float, and the distance left to the next step.
+ */
+static float expand_mjt_at(const mjt_data_t* data, double tt, double x_stepped, float* d)
+{
+    const mjt_coeff_t c = data->coeff;
+
+    double x = c.c0 + tt*(c.c1 + tt*(c.c2 + tt*(c.c3 + tt*(c.c4 + tt*c.c5))));
+
+    d[0] = (float) (c.c1 + tt*(2.0*c.c2 + tt*(3.0*c.c3 + tt*(4.0*c.c4 + tt*5.0*c.c5))));
+    d[1] = (float) (c.c2 + tt*(3.0*c.c3 + tt*(6.0*c.c4 + tt*10.0*c.c5)));
+    d[2] = (float) (c.c3 + tt*(4.0*c.c4 + tt*10.0*c.c5));
+    d[3] = (float) (c.c4 + tt*5.0*c.c5);
+    d[4] = (float) c.c5;
+
+    return (float) (data->dx - (x - x_stepped));
+}
+
+
+/**
+ * @brief Number of candidates tau_base + timestep_lut[i] that stay below the step. The candidates are increasing and
+ *        the trajectory does not move backwards, so they form a prefix of the level.
+ */
+static uint8_t count_mjt_timesteps_below_step(const float* timestep_lut, uint8_t lut_size, const float* d, float tau_base, float remaining)
+{
+    uint8_t n_below = 0;
+
+    for (uint8_t i = 0; i < lut_size; i++)
+    {
+        float tau = tau_base + timestep_lut[i];
+        float dx = tau*(d[0] + tau*(d[1] + tau*(d[2] + tau*(d[3] + tau*d[4]))));
+
+        n_below += (dx < remaining);
+    }
+
+    return n_below;
+}
+
+
+/**
+ * @brief First refinement level after the level 0 candidate i reached the step, 0 if none can refine it.
+ *        Candidate i is MJT_UNIT_TS * B^(MJT_TS_LUT_LEVEL0_FIRST_POWER + i), level k holds the digits of B^(N_LEVELS - k).
+ */
+static uint8_t mjt_timestep_starting_stage(uint8_t level0_idx)
+{
+    int stage = MJT_TS_LUT_N_LEVELS - MJT_TS_LUT_LEVEL0_FIRST_POWER - level0_idx + 1;
+
+    return (stage >= 1 && stage <= MJT_TS_LUT_N_LEVELS) ? (uint8_t) stage : 0;
+}
+
+
 static uint8_t binary_mjt_timestep_index_search(uint8_t stage, mjt_data_t* data, double x_stepped, double tt)
 {
     double x = 0;
     double two_dx = 2 * data->dx;
-    double one_and_half_dx = data->dx + data->dx / 2.0;
 
     int low = 0;
     int high = 0;
     int mid = 0;
-    const double* timestep_lut = NULL;
-    switch (stage)
+
+    if (stage < 1 || stage > MJT_TS_LUT_N_LEVELS)
     {
-        case 1:
-            high = TS_LUT_LEVEL1_SIZE - 1;
-            timestep_lut = ts_lut_level1;
-            break;
-        case 2:
-            high = TS_LUT_LEVEL2_SIZE - 1;
-            timestep_lut = ts_lut_level2;
-            break;
-        case 3:
-            high = TS_LUT_LEVEL3_SIZE - 1;
-            timestep_lut = ts_lut_level3;
-            break;
-        case 4:
-            high = TS_LUT_LEVEL4_SIZE - 1;
-            timestep_lut = ts_lut_level4;
-            break;
-        case 5:
-            high = TS_LUT_LEVEL5_SIZE - 1;
-            timestep_lut = ts_lut_level5;
-            break;
-        case 6:
-            high = TS_LUT_LEVEL6_SIZE - 1;
-            timestep_lut = ts_lut_level6;
-            break;
-        default:
-            return 254;    // invalid stage
+        return 254;    // invalid stage
     }
 
+    high = ts_lut_level_sizes[stage] - 1;
+    const double* timestep_lut = ts_lut_levels[stage];
+
     while (low <= high)
     {
         // calculate current position
@@ -304,7 +659,7 @@ mjt_coeff_t compute_mjt_coeff(mjt_bc_t bc)
 {
     mjt_coeff_t c;
 
-    uint32_t T = bc.T;
+    double T = bc.T;
     uint32_t x0 = bc.x0;
     uint32_t xT = bc.xT;
     int32_t v0 = bc.v0;
@@ -332,7 +687,12 @@ mjt_data_t init_mjt_data()
 {
     mjt_data_t output = {
     .vmax = 9999999,
+    .amax = 9999999,
+    .jmax = 9999999,
+    .profile = &mjt_profile,
     .dx = 999,
+    .engine = MJT_ENGINE_LUT_SEARCH,
+    .dda_tick = MJT_UNIT_TS,
     .dt_array = NULL,
     .n = 0,
     .bc = (mjt_bc_t){
@@ -351,7 +711,8 @@ mjt_data_t init_mjt_data()
         .c3 = 0,
         .c4 = 0,
         .c5 = 0
-        }
+        },
+    .s_curve = {0}
     };
 
     return output;
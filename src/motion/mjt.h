@@ -6,6 +6,7 @@ extern "C" {
 #endif
 
 #include <stdint.h>
+#include "s_curve.h"
 
 
 typedef struct mjt_bc
@@ -17,7 +18,7 @@ typedef struct mjt_bc
     int32_t a0;
     int32_t aT;
 
-    uint32_t T; // [s] trajectory duration
+    double T;   // [s] trajectory duration
 } mjt_bc_t;
 
 
@@ -32,21 +33,56 @@ typedef struct mjt_coeff
 } mjt_coeff_t;
 
 
+typedef enum mjt_engine
+{
+    MJT_ENGINE_LUT_SEARCH = 0,          // multi-stage binary search over the timestep LUT (default)
+    MJT_ENGINE_FORWARD_DIFFERENCE,      // fixed tick DDA, quintic advanced by 5th order forward differences
+    MJT_ENGINE_LUT_VECTOR_SEARCH,       // opt-in: same LUT, every candidate of a level counted in single precision
+} mjt_engine_t;
+
+
+typedef struct motion_profile motion_profile_t;
+
+
 typedef struct mjt_data
 {
     // input data
     uint32_t vmax; // [m/s or deg/s] maximum velocity <- this is more intiuitive than acceleration limit
+    double amax;        // [m/s^2 or deg/s^2] maximum acceleration, see gen_mjt_with_vmax_constraint()
+    double jmax;        // [m/s^3 or deg/s^3] maximum jerk, see gen_mjt_with_vmax_constraint()
+    const motion_profile_t* profile;    // motion profile, mjt_profile (default) or s_curve_profile
 
     double dx;          // [m or deg] step size
+    mjt_engine_t engine;    // step generator engine
+    double dda_tick;        // [s] tick of the forward difference engine, > 0 and shorter than the shortest step interval (else n = 0)
 
     // generated data
     uint32_t* dt_array;   // [us] mjt trajectory represented by varying time steps (one variable time step for each unit step distance)
     uint32_t n;         // number of points of the trajectory
     mjt_bc_t bc;        // boundary conditions
     mjt_coeff_t coeff;  // mjt coefficients
+    s_curve_t s_curve;  // S-curve segments, only used by s_curve_profile
 } mjt_data_t;
 
 
+/**
+ * @brief Motion profile: how a move is planned and turned into time steps. gen_mjt_*() and the output stage only go
+ *        through these functions, the profile specific data lives in mjt_data_t.
+ */
+struct motion_profile
+{
+    const char* name;
+    void (*plan_with_limits)(mjt_data_t* data);     // shortest move within vmax, amax and jmax, sets bc.T
+    void (*plan_with_time)(mjt_data_t* data);       // move of duration bc.T
+    uint32_t (*gen_steps)(mjt_data_t* data, uint32_t n_allocated_pts);  // dt_array of the planned move, returns n
+    double (*position)(const mjt_data_t* data, double t);               // distance covered at t [s] of the planned move
+};
+
+
+extern const motion_profile_t mjt_profile;      // minimum jerk quintic, smoothest, ~1.875*xT/vmax per move
+extern const motion_profile_t s_curve_profile;  // 7 segment jerk limited S-curve, cruises at vmax, rest to rest only
+
+
 // public functions
 void gen_mjt_with_vmax_constraint(mjt_data_t* data);
 void gen_mjt_with_time_constraint(mjt_data_t* data);
@@ -54,12 +90,14 @@ mjt_data_t init_mjt_data();
 
 // helper functions - private
 mjt_coeff_t compute_mjt_coeff(mjt_bc_t bc);
-static double multi_stage_binary_mjt_timestep_search(mjt_data_t* data, double* x_stepped, double* tt);
-static uint8_t binary_mjt_timestep_index_search(uint8_t stage, mjt_data_t* data, double x_stepped, double tt);
 
 
 #ifdef __cplusplus
 }
+
+extern "C++" {
+#include "mjt_constexpr.h"  // compile time trajectories
+}
 #endif
 
 #endif  // NO_JERKY_MJT_H 
\ No newline at end of file
@@ -0,0 +1,241 @@
+/**
+ * @file mjt_constexpr.h
+ * @brief C++17 constexpr front end of the minimum jerk trajectory generator.
+ *        Moves that are known at build time (homing approach, tool change, park...) can be turned into
+ *        RMT symbol tables by the compiler. Declared at namespace scope as constexpr, the tables end up
+ *        in flash (.rodata) and can be played with output_not_jerky_symbols() without any runtime generation or RAM copy.
+ *
+ * Example:
+ *      constexpr mjt_bc_t park_bc = {.x0 = 0, .xT = 2000, .v0 = 0, .vT = 0, .a0 = 0, .aT = 0, .T = 1};
+ *      constexpr auto park_dt = no_jerky::mjt_dt_array<no_jerky::mjt_step_count(park_bc, 1.0)>(park_bc, 1.0);
+ *      constexpr auto park_symbols = no_jerky::mjt_rmt_symbols<no_jerky::mjt_rmt_symbol_count(park_dt)>(park_dt);
+ *      ...
+ *      output_not_jerky_symbols(stepper.output_ch, park_symbols);
+ *
+ * NOTE: long moves may need a larger constant evaluation budget, e.g. -fconstexpr-ops-limit / -fconstexpr-loop-limit on GCC.
+ */
+#ifndef NO_JERKY_MJT_CONSTEXPR_H
+#define NO_JERKY_MJT_CONSTEXPR_H
+
+#ifdef __cplusplus
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "mjt.h"
+
+
+namespace no_jerky
+{
+
+/**
+ * @brief constexpr version of compute_mjt_coeff().
+ */
+constexpr mjt_coeff_t compute_mjt_coeff(mjt_bc_t bc)
+{
+    const double T = bc.T;
+    const double x0 = bc.x0;
+    const double xT = bc.xT;
+    const double v0 = bc.v0;
+    const double vT = bc.vT;
+    const double a0 = bc.a0;
+    const double aT = bc.aT;
+
+    mjt_coeff_t c = {};
+    c.c0 = x0;
+    c.c1 = v0;
+    c.c2 = a0/2.0;
+    c.c3 = (-3.0*T*T*a0 + T*T*aT - 12.0*T*v0 - 8.0*T*vT - 20.0*x0 + 20.0*xT)/(2.0*T*T*T);
+    c.c4 = (3.0*T*T*a0 - 2.0*T*T*aT + 16.0*T*v0 + 14.0*T*vT + 30.0*x0 - 30.0*xT)/(2.0*T*T*T*T);
+    c.c5 = (-T*T*a0 + T*T*aT - 6.0*T*v0 - 6.0*T*vT - 12.0*x0 + 12.0*xT)/(2.0*T*T*T*T*T);
+
+    return c;
+}
+
+
+/**
+ * @brief Distance covered by the trajectory at time t [s], i.e. x(t) - x0.
+ */
+constexpr double mjt_distance(const mjt_coeff_t& c, double t)
+{
+    return t*(c.c1 + t*(c.c2 + t*(c.c3 + t*(c.c4 + t*c.c5))));
+}
+
+
+/**
+ * @brief Number of steps of the trajectory, same stepping rule as gen_mjt_with_time_constraint().
+ */
+constexpr uint32_t mjt_step_count(mjt_bc_t bc, double dx)
+{
+    uint32_t n = 0;
+    double x_stepped = 0;
+
+    while (x_stepped < (double) bc.xT - (double) bc.x0)
+    {
+        x_stepped += dx;
+        n++;
+    }
+
+    return n;
+}
+
+
+/**
+ * @brief First integer us in [t_low_us, t_high_us] at which the trajectory has covered x_target.
+ *        MJT is monotonic for rest to rest moves, so a plain bisection over the 1 us RMT resolution is exact.
+ */
+constexpr uint32_t mjt_step_time_us(const mjt_coeff_t& c, double x_target, uint32_t t_low_us, uint32_t t_high_us)
+{
+    while (t_low_us < t_high_us)
+    {
+        uint32_t mid = t_low_us + (t_high_us - t_low_us) / 2;
+
+        if (mjt_distance(c, mid * 1e-6) >= x_target)
+        {
+            t_high_us = mid;
+        }
+        else
+        {
+            t_low_us = mid + 1;
+        }
+    }
+
+    return t_high_us;
+}
+
+
+/**
+ * @brief Compile time dt_array [us], one variable time step for each unit step distance.
+ *
+ * @tparam N number of steps, use mjt_step_count()
+ */
+template <uint32_t N>
+constexpr std::array<uint32_t, N> mjt_dt_array(mjt_bc_t bc, double dx)
+{
+    const mjt_coeff_t c = no_jerky::compute_mjt_coeff(bc);
+    const double distance = (double) bc.xT - (double) bc.x0;
+    const uint32_t T_us = static_cast<uint32_t>(bc.T * 1000000.0 + 0.5);
+
+    std::array<uint32_t, N> dt_array = {};
+    uint32_t last_step_us = 0;
+
+    for (uint32_t i = 0; i < N; i++)
+    {
+        double x_target = (i + 1) * dx;
+        if (x_target > distance)
+        {
+            x_target = distance;
+        }
+
+        uint32_t step_us = mjt_step_time_us(c, x_target, last_step_us, T_us);
+        dt_array[i] = step_us - last_step_us;
+        last_step_us = step_us;
+    }
+
+    return dt_array;
+}
+
+
+/**
+ * @brief Raw value of a rmt_symbol_word_t: duration0[14:0], level0[15], duration1[30:16], level1[31].
+ */
+constexpr uint32_t rmt_symbol_word_value(uint16_t duration0, uint8_t level0, uint16_t duration1, uint8_t level1)
+{
+    return ((uint32_t) duration0 & 0x7FFF) |
+           ((uint32_t) (level0 & 1) << 15) |
+           (((uint32_t) duration1 & 0x7FFF) << 16) |
+           ((uint32_t) (level1 & 1) << 31);
+}
+
+
+/**
+ * @brief Number of shifts used to split a long timestep, same rule as esp32s3_stepper_curve_to_rmt_symbol().
+ *        0 means that the timestep fits in one symbol. The split durations stay below 0x8000: a 15 bit duration of
+ *        0x8000 reads as 0, the RMT end marker.
+ */
+constexpr uint8_t rmt_big_symbol_shifts(uint32_t dt)
+{
+    if (dt <= (uint32_t) 0x8000)
+    {
+        return 0;
+    }
+
+    for (uint8_t k = 1; k < 10; k++)
+    {
+        if ((dt >> (k + 1)) < (uint32_t) 0x8000)
+        {
+            return k;
+        }
+    }
+
+    return 9;
+}
+
+static_assert((0x10000u >> (rmt_big_symbol_shifts(0x10000) + 1)) == 0x4000, "dt = 0x10000 splits into 0x4000 durations");
+static_assert((0x20000u >> (rmt_big_symbol_shifts(0x20000) + 1)) == 0x4000, "dt = 0x20000 must not split into 0x8000 (end marker)");
+
+
+/**
+ * @brief Number of RMT symbols needed to output a dt_array.
+ */
+template <std::size_t N>
+constexpr uint32_t mjt_rmt_symbol_count(const std::array<uint32_t, N>& dt_array)
+{
+    uint32_t n_symbols = 0;
+
+    for (std::size_t i = 0; i < N; i++)
+    {
+        uint8_t n_shifts = rmt_big_symbol_shifts(dt_array[i]);
+        n_symbols += (n_shifts == 0) ? 1 : 2 * (1u << (n_shifts - 1));
+    }
+
+    return n_symbols;
+}
+
+
+/**
+ * @brief Compile time RMT symbols of a dt_array, stored as raw rmt_symbol_word_t values.
+ *
+ * @tparam N_SYMBOLS number of symbols, use mjt_rmt_symbol_count()
+ */
+template <uint32_t N_SYMBOLS, std::size_t N>
+constexpr std::array<uint32_t, N_SYMBOLS> mjt_rmt_symbols(const std::array<uint32_t, N>& dt_array)
+{
+    std::array<uint32_t, N_SYMBOLS> symbols = {};
+    uint32_t symbol_size = 0;
+
+    for (std::size_t i = 0; i < N; i++)
+    {
+        uint8_t n_shifts = rmt_big_symbol_shifts(dt_array[i]);
+
+        if (n_shifts == 0)
+        {
+            // one step pulse, 50% duty
+            uint16_t symbol_duration = (uint16_t) (dt_array[i] >> 1);
+            symbols[symbol_size++] = rmt_symbol_word_value(symbol_duration, 1, symbol_duration, 0);
+        }
+        else
+        {
+            // split the duration into multiple high symbols followed by the same number of low symbols
+            uint16_t symbol_duration = (uint16_t) (dt_array[i] >> (n_shifts + 1));
+
+            for (uint32_t j = 0; j < (1u << (n_shifts - 1)); j++)
+            {
+                symbols[symbol_size++] = rmt_symbol_word_value(symbol_duration, 1, symbol_duration, 1);
+            }
+            for (uint32_t j = 0; j < (1u << (n_shifts - 1)); j++)
+            {
+                symbols[symbol_size++] = rmt_symbol_word_value(symbol_duration, 0, symbol_duration, 0);
+            }
+        }
+    }
+
+    return symbols;
+}
+
+}   // namespace no_jerky
+
+#endif  // __cplusplus
+
+#endif  // NO_JERKY_MJT_CONSTEXPR_H
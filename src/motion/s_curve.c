@@ -0,0 +1,328 @@
+#include <stdio.h>
+#include <math.h>
+
+#include "s_curve.h"
+
+
+// static functions
+static void s_curve_acceleration_phase(double v, double amax, double jmax, double* t_jerk, double* t_acc);
+static double s_curve_peak_velocity(double distance, double amax, double jmax);
+static void set_s_curve_segments(s_curve_t* s, double distance, double v, double amax, double jmax);
+static double s_curve_segment_time_at_position(const s_curve_t* s, uint8_t segment, double x);
+static double solve_s_curve_cubic(double c3, double c2, double c1, double c0, double t_max);
+
+
+/**
+ * @brief Plan the shortest rest to rest S-curve within the velocity, acceleration and jerk limits.
+ *        Short moves do not reach vmax (no cruise), very short moves do not reach amax either.
+ *
+ * @param s [out] planned S-curve
+ * @param distance [m or deg] move distance
+ * @param vmax [m/s or deg/s] maximum velocity
+ * @param amax [m/s^2 or deg/s^2] maximum acceleration
+ * @param jmax [m/s^3 or deg/s^3] maximum jerk
+ */
+void plan_s_curve(s_curve_t* s, double distance, double vmax, double amax, double jmax)
+{
+    double v_reach = s_curve_peak_velocity(distance, amax, jmax);
+
+    set_s_curve_segments(s, distance, (vmax < v_reach) ? vmax : v_reach, amax, jmax);
+}
+
+
+/**
+ * @brief Plan a rest to rest S-curve of the given duration within the acceleration and jerk limits.
+ *        The cruise velocity is found by bisection: the duration distance/v + t_acc(v) decreases with v.
+ *        NOTE: a duration shorter than the limits allow gives the shortest move instead.
+ *
+ * @param s [out] planned S-curve
+ * @param distance [m or deg] move distance
+ * @param T [s] move duration
+ * @param amax [m/s^2 or deg/s^2] maximum acceleration
+ * @param jmax [m/s^3 or deg/s^3] maximum jerk
+ */
+void plan_s_curve_with_duration(s_curve_t* s, double distance, double T, double amax, double jmax)
+{
+    double v_high = s_curve_peak_velocity(distance, amax, jmax);
+    double t_jerk = 0;
+    double t_acc = 0;
+
+    s_curve_acceleration_phase(v_high, amax, jmax, &t_jerk, &t_acc);
+
+    if (v_high <= 0 || T <= 2.0 * t_acc)
+    {
+        if (v_high > 0)
+        {
+            printf("s-curve: duration shorter than the limits allow, using the shortest move\n");
+        }
+        set_s_curve_segments(s, distance, v_high, amax, jmax);
+        return;
+    }
+
+    double v_low = distance / T;
+    for (uint8_t i = 0; i < 64; i++)
+    {
+        double v = 0.5 * (v_low + v_high);
+        s_curve_acceleration_phase(v, amax, jmax, &t_jerk, &t_acc);
+
+        if (distance / v + t_acc > T)
+        {
+            v_low = v;
+        }
+        else
+        {
+            v_high = v;
+        }
+    }
+
+    set_s_curve_segments(s, distance, 0.5 * (v_low + v_high), amax, jmax);
+}
+
+
+/**
+ * @brief Distance covered at time t [s] of a planned S-curve.
+ */
+double s_curve_position(const s_curve_t* s, double t)
+{
+    if (t <= 0)
+    {
+        return 0;
+    }
+    if (t >= s->T)
+    {
+        return s->distance;
+    }
+
+    uint8_t segment = 0;
+    while (segment < S_CURVE_N_SEGMENTS - 1 && t >= s->t[segment + 1])
+    {
+        segment++;
+    }
+
+    double tau = t - s->t[segment];
+    return s->x[segment] + tau*(s->v[segment] + tau*(s->a[segment]/2.0 + tau*s->j[segment]/6.0));
+}
+
+
+/**
+ * @brief Time [s] at which a planned S-curve reaches the distance x, in closed form.
+ *        The deceleration half is solved on the mirrored acceleration half, x(T - t) = distance - x(t), where the roots
+ *        are well conditioned: the triple root at the end of the move becomes a cube root.
+ */
+double s_curve_time_at_position(const s_curve_t* s, double x)
+{
+    if (x <= 0)
+    {
+        return 0;
+    }
+    if (x >= s->distance)
+    {
+        return s->T;
+    }
+
+    if (x > 0.5 * s->distance)
+    {
+        return s->T - s_curve_time_at_position(s, s->distance - x);
+    }
+
+    uint8_t segment = 0;
+    while (segment < S_CURVE_N_SEGMENTS - 1 && x >= s->x[segment + 1])
+    {
+        segment++;
+    }
+
+    return s_curve_segment_time_at_position(s, segment, x);
+}
+
+
+/**
+ * @brief Durations of the acceleration phase reaching the velocity v from rest: jerk segments of t_jerk and a
+ *        constant acceleration segment of t_acc - 2*t_jerk (none if amax is not reached).
+ */
+static void s_curve_acceleration_phase(double v, double amax, double jmax, double* t_jerk, double* t_acc)
+{
+    if (v * jmax >= amax * amax)
+    {
+        *t_jerk = amax / jmax;
+        *t_acc = *t_jerk + v / amax;
+    }
+    else
+    {
+        *t_jerk = sqrt(v / jmax);
+        *t_acc = 2.0 * *t_jerk;
+    }
+}
+
+
+/**
+ * @brief Highest velocity reachable over the distance, i.e. without cruise: distance = v * t_acc(v).
+ */
+static double s_curve_peak_velocity(double distance, double amax, double jmax)
+{
+    if (distance <= 0 || amax <= 0 || jmax <= 0)
+    {
+        return 0;
+    }
+
+    // amax reached: distance = v^2/amax + v*amax/jmax
+    double a2_j = amax * amax / jmax;
+    double v = 0.5 * (sqrt(a2_j * a2_j + 4.0 * distance * amax) - a2_j);
+
+    if (v * jmax < amax * amax)
+    {
+        // amax not reached: distance = 2 v^(3/2) / sqrt(jmax)
+        v = cbrt(distance * distance * jmax / 4.0);
+    }
+
+    return v;
+}
+
+
+/**
+ * @brief Segment durations for the cruise velocity v and the state at the start of each segment.
+ */
+static void set_s_curve_segments(s_curve_t* s, double distance, double v, double amax, double jmax)
+{
+    double t_jerk = 0;
+    double t_acc = 0;
+    double t_cruise = 0;
+
+    if (distance > 0 && v > 0)
+    {
+        s_curve_acceleration_phase(v, amax, jmax, &t_jerk, &t_acc);
+        t_cruise = distance / v - t_acc;
+    }
+    else
+    {
+        distance = 0;
+        v = 0;
+    }
+
+    double t_const_acc = (t_acc - 2.0 * t_jerk > 0) ? t_acc - 2.0 * t_jerk : 0;
+    t_cruise = (t_cruise > 0) ? t_cruise : 0;
+
+    const double durations[S_CURVE_N_SEGMENTS] = {t_jerk, t_const_acc, t_jerk, t_cruise, t_jerk, t_const_acc, t_jerk};
+    const double jerks[S_CURVE_N_SEGMENTS] = {jmax, 0, -jmax, 0, -jmax, 0, jmax};
+
+    s->distance = distance;
+    s->v_peak = v;
+    s->a_peak = jmax * t_jerk;
+    s->t[0] = 0;
+    s->x[0] = 0;
+    s->v[0] = 0;
+    s->a[0] = 0;
+
+    for (uint8_t i = 0; i < S_CURVE_N_SEGMENTS; i++)
+    {
+        double tau = durations[i];
+        double j = (tau > 0) ? jerks[i] : 0;
+
+        s->j[i] = j;
+        s->t[i + 1] = s->t[i] + tau;
+        s->x[i + 1] = s->x[i] + tau*(s->v[i] + tau*(s->a[i]/2.0 + tau*j/6.0));
+        s->v[i + 1] = s->v[i] + tau*(s->a[i] + tau*j/2.0);
+        s->a[i + 1] = s->a[i] + tau*j;
+    }
+
+    s->T = s->t[S_CURVE_N_SEGMENTS];
+}
+
+
+/**
+ * @brief Time at which the segment reaches x: x - x0 = v0*tau + a0*tau^2/2 + j*tau^3/6, cubic for the jerk segments,
+ *        quadratic for constant acceleration and linear for cruise.
+ */
+static double s_curve_segment_time_at_position(const s_curve_t* s, uint8_t segment, double x)
+{
+    double dx = x - s->x[segment];
+    double v = s->v[segment];
+    double a = s->a[segment];
+    double j = s->j[segment];
+    double duration = s->t[segment + 1] - s->t[segment];
+    double tau = 0;
+
+    if (j != 0)
+    {
+        tau = solve_s_curve_cubic(j / 6.0, a / 2.0, v, -dx, duration);
+    }
+    else if (a != 0)
+    {
+        // positive root of a/2 tau^2 + v tau - dx = 0, in the form without cancellation
+        double discriminant = v*v + 2.0*a*dx;
+        tau = 2.0 * dx / (v + sqrt((discriminant > 0) ? discriminant : 0));
+    }
+    else if (v > 0)
+    {
+        tau = dx / v;
+    }
+
+    tau = (tau < 0) ? 0 : tau;
+    tau = (tau > duration) ? duration : tau;
+
+    return s->t[segment] + tau;
+}
+
+
+/**
+ * @brief Root within [0, t_max] of c3*t^3 + c2*t^2 + c1*t + c0 = 0 by Cardano's formula (trigonometric form when there
+ *        are three real roots), polished by one Newton iteration.
+ */
+static double solve_s_curve_cubic(double c3, double c2, double c1, double c0, double t_max)
+{
+    // monic, then depressed by t = y - b/3: y^3 + p*y + q = 0
+    double b = c2 / c3;
+    double c = c1 / c3;
+    double d = c0 / c3;
+    double p = c - b*b/3.0;
+    double q = 2.0*b*b*b/27.0 - b*c/3.0 + d;
+    double discriminant = q*q/4.0 + p*p*p/27.0;
+
+    double roots[3];
+    uint8_t n_roots = 0;
+
+    if (discriminant >= 0)
+    {
+        double r = sqrt(discriminant);
+        roots[n_roots++] = cbrt(-q/2.0 + r) + cbrt(-q/2.0 - r) - b/3.0;
+    }
+    else
+    {
+        // three real roots, p < 0
+        double m = 2.0 * sqrt(-p/3.0);
+        double arg = 3.0*q / (p*m);
+        double phi = acos((arg > 1) ? 1 : ((arg < -1) ? -1 : arg)) / 3.0;
+
+        for (uint8_t k = 0; k < 3; k++)
+        {
+            roots[n_roots++] = m * cos(phi - 2.0*M_PI*k/3.0) - b/3.0;
+        }
+    }
+
+    // the position is monotonic within a segment: one root in range, up to rounding
+    double t = roots[0];
+    double best_distance = INFINITY;
+    for (uint8_t k = 0; k < n_roots; k++)
+    {
+        double out_of_range = (roots[k] < 0) ? -roots[k] : ((roots[k] > t_max) ? roots[k] - t_max : 0);
+        if (out_of_range < best_distance)
+        {
+            best_distance = out_of_range;
+            t = roots[k];
+        }
+    }
+
+    // kept only if it improves the residual, the derivative vanishes where the move starts and ends
+    double f = ((c3*t + c2)*t + c1)*t + c0;
+    double df = (3.0*c3*t + 2.0*c2)*t + c1;
+    if (df != 0)
+    {
+        double t_newton = t - f / df;
+        double f_newton = ((c3*t_newton + c2)*t_newton + c1)*t_newton + c0;
+        if (fabs(f_newton) < fabs(f))
+        {
+            t = t_newton;
+        }
+    }
+
+    return t;
+}
@@ -0,0 +1,47 @@
+/**
+ * @file s_curve.h
+ * @brief 7 segment jerk limited S-curve (rest to rest): jerk +J, 0, -J, cruise, -J, 0, +J.
+ *        Unlike the MJT quintic, each segment is at most a cubic in time, so the time at which a position is reached
+ *        has a closed form (Cardano for the jerk segments, quadratic for constant acceleration, linear for cruise).
+ */
+#ifndef NO_JERKY_S_CURVE_H
+#define NO_JERKY_S_CURVE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+
+#define S_CURVE_N_SEGMENTS 7
+#define S_CURVE_MIN_DT_US 2     // [us] shortest time step: both RMT symbol halves last 1 us at least, 0 is the end marker
+
+
+typedef struct s_curve
+{
+    double distance;                    // [m or deg] move distance
+    double T;                           // [s] move duration
+    double v_peak;                      // [m/s or deg/s] cruise velocity
+    double a_peak;                      // [m/s^2 or deg/s^2] acceleration of the constant acceleration segments
+
+    // state at the start of each segment, index S_CURVE_N_SEGMENTS is the end of the move
+    double t[S_CURVE_N_SEGMENTS + 1];   // [s]
+    double x[S_CURVE_N_SEGMENTS + 1];
+    double v[S_CURVE_N_SEGMENTS + 1];
+    double a[S_CURVE_N_SEGMENTS + 1];
+    double j[S_CURVE_N_SEGMENTS];       // jerk within each segment
+} s_curve_t;
+
+
+void plan_s_curve(s_curve_t* s, double distance, double vmax, double amax, double jmax);
+void plan_s_curve_with_duration(s_curve_t* s, double distance, double T, double amax, double jmax);
+double s_curve_position(const s_curve_t* s, double t);
+double s_curve_time_at_position(const s_curve_t* s, double x);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // NO_JERKY_S_CURVE_H
@@ -0,0 +1,184 @@
+#include <stdint.h>
+#include <string.h>
+#include <esp_lcd_panel_io.h>
+#include <esp_heap_caps.h>
+#include <esp_check.h>
+#include <esp_timer.h>
+
+#include "esp32s3_lcd_parallel.h"
+
+
+// static functions
+static uint32_t esp32s3_lcd_parallel_measure_gap(esp32s3_lcd_parallel_t* lcd);
+static bool esp32s3_lcd_parallel_trans_done_callback(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_io_event_data_t *edata, void *user_ctx);
+
+
+/**
+ * @brief Set up the LCD_CAM peripheral as an i80 bus that clocks out one STEP bit per axis on its data lines over DMA.
+ *        This is not limited by the 4 RMT TX channels: up to 16 axes on one bus.
+ *        NOTE: the i80 bus needs every data line of its width routed to a GPIO.
+ *
+ * @param data_pins data line pins, data line i is the STEP of axis i. Lines without an axis stay low, route them to free GPIOs
+ * @param n_data_pins bus width, 8 or 16
+ * @param pclk_pin i80 WR (pixel clock) pin - unused by the motors but it toggles, use a free GPIO
+ * @param dc_pin i80 DC pin - unused by the motors, use a free GPIO
+ * @return esp32s3_lcd_parallel_t*
+ */
+esp32s3_lcd_parallel_t* esp32s3_lcd_parallel_init(const uint8_t* data_pins, uint8_t n_data_pins, uint8_t pclk_pin, uint8_t dc_pin)
+{
+    esp32s3_lcd_parallel_t* lcd = (esp32s3_lcd_parallel_t*) calloc(1, sizeof(esp32s3_lcd_parallel_t));
+    lcd->bus_width = (n_data_pins <= 8) ? 8 : 16;
+
+    esp_lcd_i80_bus_config_t bus_config = {
+        .dc_gpio_num = dc_pin,
+        .wr_gpio_num = pclk_pin,
+        .clk_src = LCD_CLK_SRC_DEFAULT,
+        .bus_width = lcd->bus_width,
+        .max_transfer_bytes = ESP32S3_LCD_PARALLEL_BUFFER_SAMPLES * sizeof(uint16_t),
+        .psram_trans_align = 64,
+        .sram_trans_align = 4,
+    };
+    for (uint8_t i = 0; i < lcd->bus_width; i++)
+    {
+        bus_config.data_gpio_nums[i] = data_pins[i];
+    }
+    ESP_ERROR_CHECK(esp_lcd_new_i80_bus(&bus_config, &lcd->i80_bus));
+
+    lcd->free_buffers = xSemaphoreCreateCounting(ESP32S3_LCD_PARALLEL_N_BUFFERS, ESP32S3_LCD_PARALLEL_N_BUFFERS);
+
+    esp_lcd_panel_io_i80_config_t io_config = {
+        .cs_gpio_num = -1,
+        .pclk_hz = ESP32S3_LCD_PARALLEL_SAMPLES_PER_US * 1000000,
+        .trans_queue_depth = ESP32S3_LCD_PARALLEL_N_BUFFERS,
+        .on_color_trans_done = esp32s3_lcd_parallel_trans_done_callback,
+        .user_ctx = lcd,
+        .lcd_cmd_bits = 8,
+        .lcd_param_bits = 8,
+        .dc_levels = {
+            .dc_idle_level = 0,
+            .dc_cmd_level = 0,
+            .dc_dummy_level = 0,
+            .dc_data_level = 1,
+        },
+    };
+    ESP_ERROR_CHECK(esp_lcd_new_panel_io_i80(lcd->i80_bus, &io_config, &lcd->panel_io));
+
+    for (uint8_t i = 0; i < ESP32S3_LCD_PARALLEL_N_BUFFERS; i++)
+    {
+        lcd->buffers[i] = (uint16_t*) heap_caps_malloc(ESP32S3_LCD_PARALLEL_BUFFER_SAMPLES * sizeof(uint16_t), MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    }
+
+    lcd->gap_samples = esp32s3_lcd_parallel_measure_gap(lcd);
+
+    return lcd;
+}
+
+
+/**
+ * @brief Stream the merged bit-stream until every axis is done. Buffers are refilled while the previous ones are clocked out.
+ *        Blocks until the last buffer is queued.
+ *        Every buffer is its own i80 transaction and the driver starts the next one from the done interrupt of the
+ *        previous one: the data lines hold their level for lcd->gap_samples between two buffers. The merger skips that
+ *        time at every buffer, so the edges after it stay on schedule (edges inside a gap are late by gap_samples at most).
+ *
+ * @param lcd parallel output
+ * @param merger initialised merger of the axes, see init_parallel_step_merger()
+ */
+void esp32s3_lcd_parallel_output(esp32s3_lcd_parallel_t* lcd, parallel_step_merger_t* merger)
+{
+    uint8_t buffer_idx = 0;
+
+    merger->gap_samples = lcd->gap_samples;
+
+    while (1)
+    {
+        xSemaphoreTake(lcd->free_buffers, portMAX_DELAY);
+
+        uint16_t* samples = lcd->buffers[buffer_idx];
+        uint32_t n_samples = fill_parallel_step_samples(merger, samples, ESP32S3_LCD_PARALLEL_BUFFER_SAMPLES);
+
+        if (n_samples == 0)
+        {
+            xSemaphoreGive(lcd->free_buffers);
+            break;
+        }
+
+        size_t n_bytes = n_samples * sizeof(uint16_t);
+        if (lcd->bus_width == 8)
+        {
+            // one byte per sample, packed in place
+            uint8_t* bytes = (uint8_t*) samples;
+            for (uint32_t i = 0; i < n_samples; i++)
+            {
+                bytes[i] = (uint8_t) samples[i];
+            }
+            n_bytes = n_samples;
+        }
+
+        // no command phase, the data lines are the STEP outputs
+        ESP_ERROR_CHECK(esp_lcd_panel_io_tx_color(lcd->panel_io, -1, samples, n_bytes));
+
+        buffer_idx = (buffer_idx + 1) % ESP32S3_LCD_PARALLEL_N_BUFFERS;
+
+        if (n_samples < ESP32S3_LCD_PARALLEL_BUFFER_SAMPLES)
+        {
+            break;  // last buffer
+        }
+    }
+}
+
+
+static uint32_t esp32s3_lcd_parallel_measure_gap(esp32s3_lcd_parallel_t* lcd);
+/**
+ * @brief Measure the bus idle time between two queued buffers: full buffers of idle (low) samples are clocked out back
+ *        to back, the transfer done interrupts are then one buffer plus one gap apart. About +-1 sample.
+ */
+static uint32_t esp32s3_lcd_parallel_measure_gap(esp32s3_lcd_parallel_t* lcd)
+{
+    for (uint8_t i = 0; i < ESP32S3_LCD_PARALLEL_N_BUFFERS; i++)
+    {
+        memset(lcd->buffers[i], 0, ESP32S3_LCD_PARALLEL_BUFFER_SAMPLES * sizeof(uint16_t));
+    }
+
+    size_t n_bytes = ESP32S3_LCD_PARALLEL_BUFFER_SAMPLES * ((lcd->bus_width == 8) ? 1 : sizeof(uint16_t));
+
+    lcd->n_done = 0;
+    for (uint8_t i = 0; i < ESP32S3_LCD_PARALLEL_GAP_BUFFERS; i++)
+    {
+        xSemaphoreTake(lcd->free_buffers, portMAX_DELAY);
+        ESP_ERROR_CHECK(esp_lcd_panel_io_tx_color(lcd->panel_io, -1, lcd->buffers[i % ESP32S3_LCD_PARALLEL_N_BUFFERS], n_bytes));
+    }
+    for (uint8_t i = 0; i < ESP32S3_LCD_PARALLEL_N_BUFFERS; i++)
+    {
+        xSemaphoreTake(lcd->free_buffers, portMAX_DELAY);
+    }
+    for (uint8_t i = 0; i < ESP32S3_LCD_PARALLEL_N_BUFFERS; i++)
+    {
+        xSemaphoreGive(lcd->free_buffers);
+    }
+
+    // [sample] time of one buffer plus one gap, averaged over the buffers
+    int64_t period = ((lcd->last_done_time - lcd->first_done_time) * ESP32S3_LCD_PARALLEL_SAMPLES_PER_US
+                      + (ESP32S3_LCD_PARALLEL_GAP_BUFFERS - 1) / 2) / (ESP32S3_LCD_PARALLEL_GAP_BUFFERS - 1);
+
+    return (period > ESP32S3_LCD_PARALLEL_BUFFER_SAMPLES) ? (uint32_t) (period - ESP32S3_LCD_PARALLEL_BUFFER_SAMPLES) : 0;
+}
+
+
+static bool esp32s3_lcd_parallel_trans_done_callback(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_io_event_data_t *edata, void *user_ctx)
+{
+    esp32s3_lcd_parallel_t* lcd = (esp32s3_lcd_parallel_t*) user_ctx;
+    BaseType_t high_task_woken = pdFALSE;
+    int64_t now = esp_timer_get_time();
+
+    if (lcd->n_done == 0)
+    {
+        lcd->first_done_time = now;
+    }
+    lcd->last_done_time = now;
+    lcd->n_done++;
+
+    xSemaphoreGiveFromISR(lcd->free_buffers, &high_task_woken);
+
+    return high_task_woken == pdTRUE;
+}
@@ -0,0 +1,42 @@
+#ifndef ESP32S3_LCD_PARALLEL_H
+#define ESP32S3_LCD_PARALLEL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <esp_lcd_panel_io.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include "parallel_step_merge.h"
+
+
+#define ESP32S3_LCD_PARALLEL_N_BUFFERS 4           // DMA buffers in flight
+#define ESP32S3_LCD_PARALLEL_BUFFER_SAMPLES 4096   // samples per DMA buffer
+#define ESP32S3_LCD_PARALLEL_SAMPLES_PER_US 2      // bus clock [MHz], step edge resolution is 0.5 us
+#define ESP32S3_LCD_PARALLEL_GAP_BUFFERS 16        // idle buffers clocked out at init to measure the gap between buffers
+
+
+typedef struct esp32s3_lcd_parallel {
+    esp_lcd_i80_bus_handle_t i80_bus;
+    esp_lcd_panel_io_handle_t panel_io;
+    uint8_t bus_width;                                          // 8 or 16 data lines
+    uint16_t* buffers[ESP32S3_LCD_PARALLEL_N_BUFFERS];          // DMA capable sample buffers
+    SemaphoreHandle_t free_buffers;                             // given from the transfer done ISR
+    uint32_t gap_samples;                                       // [sample] bus idle time between two queued buffers
+    volatile uint32_t n_done;                                   // transfers done, with the time of the first and last one
+    volatile int64_t first_done_time;                           // [us]
+    volatile int64_t last_done_time;                            // [us]
+} esp32s3_lcd_parallel_t;
+
+
+// public functions
+esp32s3_lcd_parallel_t* esp32s3_lcd_parallel_init(const uint8_t* data_pins, uint8_t n_data_pins, uint8_t pclk_pin, uint8_t dc_pin);
+void esp32s3_lcd_parallel_output(esp32s3_lcd_parallel_t* lcd, parallel_step_merger_t* merger);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ESP32S3_LCD_PARALLEL_H
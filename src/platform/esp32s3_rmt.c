@@ -1,18 +1,39 @@
 #include <stdint.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 #include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_memory_utils.h>
+#include <esp_rom_gpio.h>
+#include <driver/gpio.h>
+#include <soc/soc.h>
+#include <soc/gpio_reg.h>
 
 #include "esp32s3_rmt.h"
 
 
-typedef struct esp32s3_rmt_curve_encoder {
-    rmt_encoder_t base;
-    rmt_encoder_handle_t copy_encoder;
-    uint32_t n_symbols;
-    rmt_symbol_word_t* curve_symbols;
-} esp32s3_rmt_curve_encoder_t;
+// static functions
+static size_t esp32s3_rmt_encode_feed_rate_symbols(const void *data, size_t data_size, size_t symbols_written, size_t symbols_free, rmt_symbol_word_t *symbols, bool *done, void *arg);
+static void esp32s3_rmt_scale_symbol(esp32s3_rmt_feed_rate_t* feed_rate, rmt_symbol_word_t symbol);
+static uint32_t esp32s3_rmt_scale_duration(esp32s3_rmt_feed_rate_t* feed_rate, uint32_t duration, uint32_t period_scale);
+static void esp32s3_rmt_update_feed_rate(esp32s3_rmt_feed_rate_t* feed_rate, uint32_t output_duration);
+static bool esp32s3_rmt_tx_done_callback(rmt_channel_handle_t channel, const rmt_tx_done_event_data_t *edata, void *user_data);
+static esp32s3_rmt_tx_queue_t* esp32s3_rmt_new_tx_queue(rmt_channel_handle_t rmt_channel);
+static void esp32s3_rmt_write_telemetry_begin(esp32s3_rmt_telemetry_t* telemetry);
+static void esp32s3_rmt_write_telemetry_end(esp32s3_rmt_telemetry_t* telemetry);
+static uint32_t esp32s3_rmt_step_period(const rmt_symbol_word_t* symbols, uint32_t n_halves, uint32_t half);
+static bool increase_allocated_curve_memory_check(uint32_t current_size, uint32_t* current_max_size, rmt_symbol_word_t **curve);
 
 
-rmt_channel_handle_t esp32s3_rmt_init(uint8_t step_pin)
+/**
+ * @brief Create a RMT TX channel with its transaction book keeping
+ * 
+ * @param step_pin output pin of the channel
+ * @param tx_queue [out] transaction book keeping of the channel, see esp32s3_rmt_transmit()
+ * @return rmt_channel_handle_t 
+ */
+rmt_channel_handle_t esp32s3_rmt_init(uint8_t step_pin, esp32s3_rmt_tx_queue_t** tx_queue)
 {
     rmt_channel_handle_t rmt_channel;
 
@@ -21,7 +42,7 @@ rmt_channel_handle_t esp32s3_rmt_init(uint8_t step_pin)
         .gpio_num = (gpio_num_t) step_pin,
         .clk_src = RMT_CLK_SRC_DEFAULT,
         .mem_block_symbols = 48,    // memory block size, n * 4 = 4n Bytes 
-        .trans_queue_depth = 10,    // number of transactions that can be queued in the background
+        .trans_queue_depth = ESP32S3_RMT_TRANS_QUEUE_DEPTH, // number of transactions that can be queued in the background
         .resolution_hz = 1000000,   // 1 MHz resolution
         .flags.invert_out = false,  // output signal is not inverted
         // .flags.with_dma = true,     // use DMA - limited to only 1 channel if using DMA!!!
@@ -29,50 +50,462 @@ rmt_channel_handle_t esp32s3_rmt_init(uint8_t step_pin)
 
     ESP_ERROR_CHECK(rmt_new_tx_channel(&rmt_tx_config, &rmt_channel));   
 
+    // register RMT callback before enabling the channel, IRAM-safe with CONFIG_NO_JERKY_ISR_IRAM_SAFE
+    *tx_queue = esp32s3_rmt_new_tx_queue(rmt_channel);
+
     // enable RMT channels
     ESP_ERROR_CHECK(rmt_enable(rmt_channel));
-    
-    // TODO: register RMT callback - this should be in IRAM. See API reference footer 2
 
     return rmt_channel;
 }
 
 
-esp_err_t esp32s3_rmt_new_stepper_curve_encoder(esp32s3_rmt_encoder_data_t *encoder_data)
+/**
+ * @brief Create the transaction book keeping of a channel and register its tx done callback.
+ * 
+ * @param rmt_channel RMT channel, must not be enabled yet
+ * @return esp32s3_rmt_tx_queue_t* 
+ */
+static esp32s3_rmt_tx_queue_t* esp32s3_rmt_new_tx_queue(rmt_channel_handle_t rmt_channel)
 {
-    esp_err_t ret = ESP_OK;
+    // accessed from the tx done ISR
+    esp32s3_rmt_tx_queue_t* tx_queue = (esp32s3_rmt_tx_queue_t*) heap_caps_calloc(1, sizeof(esp32s3_rmt_tx_queue_t), ESP32S3_RMT_MALLOC_CAPS);
+    tx_queue->direction = 1;
+    portMUX_INITIALIZE(&tx_queue->lock);
+    portMUX_INITIALIZE(&tx_queue->cursor_lock);
+
+    rmt_copy_encoder_config_t copy_encoder_config = {};
+    ESP_ERROR_CHECK(rmt_new_copy_encoder(&copy_encoder_config, &tx_queue->copy_encoder));
+
+    tx_queue->feed_rate.target = ESP32S3_RMT_FEED_RATE_ONE;
+    tx_queue->feed_rate.rate = ESP32S3_RMT_FEED_RATE_ONE;
+    tx_queue->feed_rate.ramp_from = ESP32S3_RMT_FEED_RATE_ONE;
+    tx_queue->feed_rate.ramp_to = ESP32S3_RMT_FEED_RATE_ONE;
 
-    esp32s3_rmt_curve_encoder_t* step_encoder = NULL;
+    rmt_simple_encoder_config_t feed_rate_encoder_config = {
+        .callback = esp32s3_rmt_encode_feed_rate_symbols,
+        .arg = tx_queue,
+        .min_chunk_size = 1,    // scaled symbols wait in the scratch until there is room
+    };
+    ESP_ERROR_CHECK(rmt_new_simple_encoder(&feed_rate_encoder_config, &tx_queue->feed_rate_encoder));
+
+    rmt_tx_event_callbacks_t callbacks = {
+        .on_trans_done = esp32s3_rmt_tx_done_callback,
+    };
+    ESP_ERROR_CHECK(rmt_tx_register_event_callbacks(rmt_channel, &callbacks, tx_queue));
+
+    return tx_queue;
+}
 
 
-    // allocate memory for the encoder
-    printf("Allocating memory for the RMT encoder\n");
-    step_encoder = rmt_alloc_encoder_mem(sizeof(esp32s3_rmt_curve_encoder_t) + encoder_data->n_symbols * sizeof(rmt_symbol_word_t));
-    if (step_encoder == NULL)
+/**
+ * @brief Queue a transmission and keep track of it, all transmissions of a channel must go through here.
+ *        owned_buffer (if not NULL) is freed once the transaction is done (checked on the next call or by esp32s3_rmt_release_done_buffers()).
+ * 
+ * @param rmt_channel RMT channel
+ * @param tx_queue transaction book keeping of the channel
+ * @param encoder RMT encoder, NULL to copy pre-encoded symbols with the channel's copy encoder.
+ *                tx_queue->feed_rate_encoder to copy them scaled by the feed rate, see esp32s3_rmt_set_feed_rate()
+ * @param payload data passed to the encoder, it must stay valid until the transaction is done
+ * @param payload_bytes size of the payload
+ * @param owned_buffer malloc'd buffer owned by the transaction, e.g. the payload itself. Can be NULL. Freed on error
+ * @param info steps and duration of the transaction for the telemetry, and its end of transmission level. NULL if no steps (idle low)
+ * @return esp_err_t ESP_ERR_NO_MEM (IRAM-safe copy), the error of rmt_transmit() (nothing is queued) or ESP_OK
+ */
+esp_err_t esp32s3_rmt_transmit(rmt_channel_handle_t rmt_channel, esp32s3_rmt_tx_queue_t* tx_queue, rmt_encoder_handle_t encoder, const void* payload, size_t payload_bytes, void* owned_buffer, const esp32s3_rmt_trans_info_t* info)
+{
+    esp32s3_rmt_trans_info_t trans_info = {0};
+    if (info != NULL)
     {
-        printf("Failed to allocate memory for the RMT encoder\n");
+        trans_info = *info;
     }
-    printf("Allocated memory for the RMT encoder\n");
 
-    // create new copy encoder
-    rmt_copy_encoder_config_t copy_encoder_config = {};
-    if (rmt_new_copy_encoder(&copy_encoder_config, &step_encoder->copy_encoder) != ESP_OK)
+    rmt_transmit_config_t rmt_tx_config = {.loop_count=0};
+    rmt_tx_config.flags.eot_level = trans_info.eot_level;
+
+#if CONFIG_NO_JERKY_ISR_IRAM_SAFE
+    // the copy and feed rate encoders read the payload from the refill ISR: flash-resident (or PSRAM) symbols need a DRAM copy
+    if ((encoder == NULL || encoder == tx_queue->feed_rate_encoder) && !esp_ptr_internal(payload))
+    {
+        void* internal_payload = heap_caps_malloc(payload_bytes, ESP32S3_RMT_MALLOC_CAPS);
+        if (internal_payload == NULL)
+        {
+            free(owned_buffer);
+            return ESP_ERR_NO_MEM;
+        }
+
+        memcpy(internal_payload, payload, payload_bytes);
+        free(owned_buffer);
+        payload = internal_payload;
+        owned_buffer = internal_payload;
+    }
+#endif
+
+    // wait for a free buffer slot - the RMT transaction queue has the same depth
+    esp32s3_rmt_release_done_buffers(tx_queue);
+    while (tx_queue->n_queued - tx_queue->n_done >= ESP32S3_RMT_TRANS_QUEUE_DEPTH)
+    {
+        vTaskDelay(1);
+        esp32s3_rmt_release_done_buffers(tx_queue);
+    }
+
+    // the symbols are walked by esp32s3_rmt_walk_active_steps(), they stay valid until the transaction is done
+    if (encoder == NULL || encoder == tx_queue->feed_rate_encoder)
+    {
+        trans_info.symbols = (const rmt_symbol_word_t*) payload;
+        trans_info.n_symbols = payload_bytes / sizeof(rmt_symbol_word_t);
+    }
+
+    uint8_t slot = tx_queue->n_queued % ESP32S3_RMT_TRANS_QUEUE_DEPTH;
+    tx_queue->buffers[slot] = owned_buffer;
+    tx_queue->info[slot] = trans_info;
+
+    portENTER_CRITICAL(&tx_queue->lock);
+    if (tx_queue->n_queued == tx_queue->n_done)
+    {
+        // idle channel: no tx done ISR will start this transaction, it becomes the active one right away
+        esp32s3_rmt_write_telemetry_begin(&tx_queue->telemetry);
+        tx_queue->telemetry.active = trans_info;
+        tx_queue->telemetry.time_base = esp_timer_get_time();
+        tx_queue->telemetry.n_anchors = 0;
+        esp32s3_rmt_write_telemetry_end(&tx_queue->telemetry);
+    }
+    tx_queue->n_queued++;
+    portEXIT_CRITICAL(&tx_queue->lock);
+
+    if (encoder == NULL)
+    {
+        encoder = tx_queue->copy_encoder;
+    }
+
+    esp_err_t err = rmt_transmit(rmt_channel, encoder, payload, payload_bytes, &rmt_tx_config);
+    if (err != ESP_OK)
+    {
+        // not queued: no tx done ISR will count it
+        portENTER_CRITICAL(&tx_queue->lock);
+        tx_queue->n_queued--;
+        if (tx_queue->n_queued == tx_queue->n_done)
+        {
+            esp32s3_rmt_write_telemetry_begin(&tx_queue->telemetry);
+            tx_queue->telemetry.active = (esp32s3_rmt_trans_info_t) {0};
+            esp32s3_rmt_write_telemetry_end(&tx_queue->telemetry);
+        }
+        portEXIT_CRITICAL(&tx_queue->lock);
+
+        tx_queue->buffers[slot] = NULL;
+        free(owned_buffer);
+    }
+
+    return err;
+}
+
+
+/**
+ * @brief Record the start error of a deadline start, ISR safe (called from the first step edge ISR).
+ * 
+ * @param tx_queue transaction book keeping of the channel
+ * @param error [us] first step edge - deadline
+ */
+void ESP32S3_RMT_ISR_ATTR esp32s3_rmt_record_start_error(esp32s3_rmt_tx_queue_t* tx_queue, int32_t error)
+{
+    esp32s3_rmt_start_stats_t* stats = &tx_queue->telemetry.start_stats;
+
+    portENTER_CRITICAL_ISR(&tx_queue->lock);
+    esp32s3_rmt_write_telemetry_begin(&tx_queue->telemetry);
+
+    stats->min_error = (stats->count == 0 || error < stats->min_error) ? error : stats->min_error;
+    stats->max_error = (stats->count == 0 || error > stats->max_error) ? error : stats->max_error;
+    stats->sum_error += error;
+    stats->count++;
+
+    esp32s3_rmt_write_telemetry_end(&tx_queue->telemetry);
+    portEXIT_CRITICAL_ISR(&tx_queue->lock);
+}
+
+
+/**
+ * @brief Count a deadline start that could not be queued.
+ */
+void esp32s3_rmt_record_start_failure(esp32s3_rmt_tx_queue_t* tx_queue)
+{
+    portENTER_CRITICAL(&tx_queue->lock);
+    esp32s3_rmt_write_telemetry_begin(&tx_queue->telemetry);
+    tx_queue->telemetry.start_stats.failed++;
+    esp32s3_rmt_write_telemetry_end(&tx_queue->telemetry);
+    portEXIT_CRITICAL(&tx_queue->lock);
+}
+
+
+/**
+ * @brief Free the symbols of the transactions that are done.
+ */
+void esp32s3_rmt_release_done_buffers(esp32s3_rmt_tx_queue_t* tx_queue)
+{
+    uint32_t n_done = tx_queue->n_done;
+
+    while (tx_queue->n_released != n_done)
+    {
+        uint8_t slot = tx_queue->n_released % ESP32S3_RMT_TRANS_QUEUE_DEPTH;
+        free(tx_queue->buffers[slot]);
+        tx_queue->buffers[slot] = NULL;
+        tx_queue->n_released++;
+    }
+}
+
+
+/**
+ * @brief Set the feed rate of the symbols sent with tx_queue->feed_rate_encoder: their durations are divided by the
+ *        feed rate as they are written to the RMT memory, i.e. a rest-to-rest move runs in T / feed_rate without being
+ *        regenerated. While moving, the feed rate follows a minimum jerk ramp (smoothstep) to the new value.
+ * 
+ * @param tx_queue transaction book keeping of the channel
+ * @param feed_rate [Q16] new feed rate, clamped to ESP32S3_RMT_FEED_RATE_MIN..ESP32S3_RMT_FEED_RATE_MAX
+ * @param ramp_duration [us] of output over which the feed rate is changed, ignored if the channel is idle
+ */
+void esp32s3_rmt_set_feed_rate(esp32s3_rmt_tx_queue_t* tx_queue, uint32_t feed_rate, uint32_t ramp_duration)
+{
+    esp32s3_rmt_feed_rate_t* rate = &tx_queue->feed_rate;
+
+    feed_rate = (feed_rate < ESP32S3_RMT_FEED_RATE_MIN) ? ESP32S3_RMT_FEED_RATE_MIN : feed_rate;
+    feed_rate = (feed_rate > ESP32S3_RMT_FEED_RATE_MAX) ? ESP32S3_RMT_FEED_RATE_MAX : feed_rate;
+
+    if (tx_queue->n_queued == tx_queue->n_done)
+    {
+        // idle: the encoder is not running, nothing to ramp
+        rate->ramp_from = feed_rate;
+        rate->ramp_to = feed_rate;
+        rate->rate = feed_rate;
+        rate->target = feed_rate;
+        return;
+    }
+
+    // picked up by the encoder at its next symbol, 1 / duration is computed here: no 64 bit division in the ISR
+    rate->ramp_duration = ramp_duration;
+    rate->ramp_duration_inverse = (ramp_duration > 1) ? (uint32_t) ((1ULL << 32) / ramp_duration) : UINT32_MAX;
+    __atomic_store_n(&rate->target, feed_rate, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * @brief Lock-free snapshot of the telemetry of a channel, from any task or core.
+ *        Seqlock read: retried while the tx done ISR is updating it, the ISR is never blocked.
+ * 
+ * @param tx_queue transaction book keeping of the channel
+ * @param telemetry [out] consistent copy of the telemetry
+ */
+void esp32s3_rmt_read_telemetry(const esp32s3_rmt_tx_queue_t* tx_queue, esp32s3_rmt_telemetry_t* telemetry)
+{
+    uint32_t seq_begin;
+    uint32_t seq_end;
+
+    do
+    {
+        seq_begin = __atomic_load_n(&tx_queue->telemetry.seq, __ATOMIC_ACQUIRE);
+
+        telemetry->position = tx_queue->telemetry.position;
+        telemetry->symbols_sent = tx_queue->telemetry.symbols_sent;
+        telemetry->time_base = tx_queue->telemetry.time_base;
+        telemetry->active = tx_queue->telemetry.active;
+        telemetry->start_stats = tx_queue->telemetry.start_stats;
+        telemetry->n_anchors = tx_queue->telemetry.n_anchors;
+        memcpy(telemetry->anchors, tx_queue->telemetry.anchors, sizeof(telemetry->anchors));
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        seq_end = __atomic_load_n(&tx_queue->telemetry.seq, __ATOMIC_RELAXED);
+    } while ((seq_begin & 1) || seq_begin != seq_end);
+
+    telemetry->seq = seq_begin;
+}
+
+
+/**
+ * @brief Nominal time [us] (100% feed rate) into the active transaction at esp_timer time now, and the feed rate there.
+ *        The output time since the telemetry time_base is mapped to nominal time by interpolating between the encoder
+ *        refills that bracket it (their output and nominal times are exact): changes of the feed rate and its ramp
+ *        only apply from the symbols they were encoded in, and the unscaled setup gap is not scaled. Transactions not
+ *        feed rate encoded run at 100%.
+ * 
+ * @param telemetry telemetry read with esp32s3_rmt_read_telemetry(), with an active transaction
+ * @param now [us] esp_timer time
+ * @param feed_rate [out] [Q16] feed rate of the symbols being output
+ * @return uint32_t [us] nominal time into the transaction, active.duration at most
+ */
+uint32_t esp32s3_rmt_nominal_elapsed(const esp32s3_rmt_telemetry_t* telemetry, int64_t now, uint32_t* feed_rate)
+{
+    int64_t output = now - telemetry->time_base;
+    int64_t nominal = output;
+    uint32_t n = telemetry->n_anchors;
+
+    *feed_rate = ESP32S3_RMT_FEED_RATE_ONE;
+    output = (output > 0) ? output : 0;
+
+    if (n > 0)
+    {
+        // first anchor whose predecessor is still kept, the transaction starts at 0 / 0
+        uint32_t k = (n > ESP32S3_RMT_TIME_ANCHORS) ? n - ESP32S3_RMT_TIME_ANCHORS + 1 : 0;
+        esp32s3_rmt_time_anchor_t from = (k == 0) ? (esp32s3_rmt_time_anchor_t) {0} : telemetry->anchors[(k - 1) % ESP32S3_RMT_TIME_ANCHORS];
+        esp32s3_rmt_time_anchor_t to = telemetry->anchors[k % ESP32S3_RMT_TIME_ANCHORS];
+
+        // the output is behind the last refill, extrapolated from the last segment otherwise (end of the transaction)
+        while (output > to.output && k + 1 < n)
+        {
+            k++;
+            from = to;
+            to = telemetry->anchors[k % ESP32S3_RMT_TIME_ANCHORS];
+        }
+
+        if (to.output > from.output)
+        {
+            nominal = from.nominal + (output - (int64_t) from.output) * (to.nominal - from.nominal) / (to.output - from.output);
+            *feed_rate = (uint32_t) (((uint64_t) (to.nominal - from.nominal) << 16) / (to.output - from.output));
+        }
+        else
+        {
+            nominal = from.nominal;
+        }
+    }
+
+    if (nominal > telemetry->active.duration)
     {
-        printf("Failed to create new RMT copy encoder\n");
-        return ESP_FAIL;
+        nominal = telemetry->active.duration;     // the tx done ISR is about to run
     }
-    printf("Created new RMT copy encoder\n");
 
-    // set the RMT encoder data
-    step_encoder->base.del = esp32s3_rmt_del_stepper_curve_encoder;
-    step_encoder->base.reset = esp32s3_rmt_reset_stepper_curve_encoder;
-    step_encoder->base.encode = esp32s3_rmt_encode_stepper_curve;
+    return (nominal > 0) ? (uint32_t) nominal : 0;
+}
+
+
+/**
+ * @brief Steps of the active transaction output elapsed [us] into it (nominal time, i.e. at 100% feed rate), and the
+ *        period of the step being output, by walking the symbols of the transaction.
+ *        The walk resumes from the furthest one so far on the same transaction: polled from a control loop, it costs
+ *        the symbols output since the last call. NOTE: with concurrent callers, a caller can start from a walk a few
+ *        us ahead of its own elapsed.
+ * 
+ * @param tx_queue transaction book keeping of the channel
+ * @param telemetry telemetry read with esp32s3_rmt_read_telemetry(), with an active transaction
+ * @param elapsed [us] nominal time into the active transaction
+ * @param steps [out] rising edges output so far
+ * @param step_period [out] [us] nominal period of the step being output, 0 before the first one
+ * @return bool false if the transaction was done while walking it (its symbols may be freed), read the telemetry again
+ */
+bool esp32s3_rmt_walk_active_steps(esp32s3_rmt_tx_queue_t* tx_queue, const esp32s3_rmt_telemetry_t* telemetry, uint32_t elapsed, uint32_t* steps, uint32_t* step_period)
+{
+    const esp32s3_rmt_trans_info_t* active = &telemetry->active;
+    const uint32_t n_halves = 2 * active->n_symbols;
+    esp32s3_rmt_symbol_cursor_t cursor;
+
+    portENTER_CRITICAL(&tx_queue->cursor_lock);
+    cursor = tx_queue->cursor;
+    portEXIT_CRITICAL(&tx_queue->cursor_lock);
+
+    if (cursor.symbols != active->symbols || cursor.time_base != telemetry->time_base)
+    {
+        // first walk of this transaction
+        cursor = (esp32s3_rmt_symbol_cursor_t) {
+            .symbols = active->symbols,
+            .time_base = telemetry->time_base,
+        };
+    }
+
+    // every half that has started, its rising edge included
+    while (cursor.half < n_halves && cursor.elapsed <= elapsed)
+    {
+        rmt_symbol_word_t symbol = active->symbols[cursor.half / 2];
+        uint8_t level = (cursor.half & 1) ? symbol.level1 : symbol.level0;
+
+        if (level && !cursor.level)
+        {
+            cursor.steps++;
+            cursor.step_period = esp32s3_rmt_step_period(active->symbols, n_halves, cursor.half);
+        }
+
+        cursor.level = level;
+        cursor.elapsed += (cursor.half & 1) ? symbol.duration1 : symbol.duration0;
+        cursor.half++;
+    }
+
+    // the symbols are freed after the tx done ISR has published the end of the transaction
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&tx_queue->telemetry.seq, __ATOMIC_RELAXED) != telemetry->seq)
+    {
+        return false;
+    }
+
+    portENTER_CRITICAL(&tx_queue->cursor_lock);
+    if (tx_queue->cursor.symbols != cursor.symbols || tx_queue->cursor.time_base != cursor.time_base || tx_queue->cursor.half < cursor.half)
+    {
+        tx_queue->cursor = cursor;
+    }
+    portEXIT_CRITICAL(&tx_queue->cursor_lock);
+
+    *steps = cursor.steps;
+    *step_period = cursor.step_period;
+    return true;
+}
+
+
+/**
+ * @brief Allocate RMT symbols that can be read by the refill ISR (internal DRAM in IRAM-safe mode). Free with free().
+ */
+rmt_symbol_word_t* esp32s3_rmt_alloc_symbols(uint32_t n_symbols)
+{
+    return (rmt_symbol_word_t*) heap_caps_malloc(n_symbols * sizeof(rmt_symbol_word_t), ESP32S3_RMT_MALLOC_CAPS);
+}
+
+
+/**
+ * @brief Number of steps (rising STEP edges) in RMT symbols, the output is low before the first symbol.
+ */
+uint32_t esp32s3_rmt_count_steps(const rmt_symbol_word_t *symbols, uint32_t n_symbols)
+{
+    uint32_t n_steps = 0;
+    uint8_t level = 0;
+
+    for (uint32_t i = 0; i < n_symbols; i++)
+    {
+        n_steps += (symbols[i].level0 & ~level) & 1;
+        n_steps += (symbols[i].level1 & ~symbols[i].level0) & 1;
+        level = symbols[i].level1;
+    }
+
+    return n_steps;
+}
+
+
+/**
+ * @brief Drive follower_pin with the output signal of source_pin through the GPIO matrix, e.g. a second STEP pin fed by
+ *        the RMT channel of the first one. No extra peripheral, the edges are the same (GPIO matrix delay only).
+ *        NOTE: source_pin must already be routed to its peripheral, a plain GPIO output cannot be followed this way.
+ * 
+ * @param source_pin pin driven by a peripheral output signal (RMT channel)
+ * @param follower_pin pin to drive with the same signal
+ * @param invert invert the signal on follower_pin, e.g. DIR of a mirrored gantry motor
+ */
+void esp32s3_route_output_signal(uint8_t source_pin, uint8_t follower_pin, bool invert)
+{
+    // output signal selected by the GPIO matrix for the source pin
+    uint32_t signal_idx = REG_GET_FIELD(GPIO_FUNC0_OUT_SEL_CFG_REG + 4 * source_pin, GPIO_FUNC0_OUT_SEL);
+
+    esp_rom_gpio_pad_select_gpio(follower_pin);
+    gpio_set_direction((gpio_num_t) follower_pin, GPIO_MODE_OUTPUT);
+    esp_rom_gpio_connect_out_signal(follower_pin, signal_idx, invert, false);
+}
+
+
+/**
+ * @brief Create a sync manager so that the transmissions of the channels start at the same time.
+ */
+rmt_sync_manager_handle_t esp32s3_rmt_new_sync_manager(rmt_channel_handle_t* rmt_channels, uint8_t n_channels)
+{
+    rmt_sync_manager_handle_t sync_manager = NULL;
 
-    encoder_data->rmt_encoder = &(step_encoder->base);
-    step_encoder->n_symbols = encoder_data->n_symbols;
-    step_encoder->curve_symbols = encoder_data->symbols;
+    rmt_sync_manager_config_t sync_manager_config = {
+        .tx_channel_array = rmt_channels,
+        .array_size = n_channels,
+    };
+    ESP_ERROR_CHECK(rmt_new_sync_manager(&sync_manager_config, &sync_manager));
 
-    return ret;
+    return sync_manager;
 }
 
 
@@ -81,21 +514,32 @@ esp_err_t esp32s3_rmt_new_stepper_curve_encoder(esp32s3_rmt_encoder_data_t *enco
  * 
  * @param curve 
  * @param curve_size 
- * @param curve_symbol_word 
+ * @param n_leading symbols reserved (not set) before the curve, e.g. a DIR setup gap filled in by the caller
+ * @param curve_symbol_word allocated symbols, n_leading included, NULL if out of memory
  * @param curve_symbol_word_size 
+ * @return esp_err_t ESP_ERR_NO_MEM or ESP_OK
  */
-void esp32s3_stepper_curve_to_rmt_symbol(uint32_t* curve, uint32_t curve_size, rmt_symbol_word_t **curve_symbol_word, uint32_t *curve_symbol_word_size)
+esp_err_t esp32s3_stepper_curve_to_rmt_symbol(uint32_t* curve, uint32_t curve_size, uint32_t n_leading, rmt_symbol_word_t **curve_symbol_word, uint32_t *curve_symbol_word_size)
 {
     // --- convert user data into RMT symbol format ---
     // allocate memory for the curve, start with the input data size
-    uint32_t allocated_curve_memory = curve_size;
-    (*curve_symbol_word) = (rmt_symbol_word_t*) malloc(allocated_curve_memory * sizeof(rmt_symbol_word_t));
+    uint32_t allocated_curve_memory = (curve_size + n_leading > 0) ? curve_size + n_leading : 1;
+    (*curve_symbol_word) = esp32s3_rmt_alloc_symbols(allocated_curve_memory);
+    *curve_symbol_word_size = 0;
+
+    if ((*curve_symbol_word) == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
 
-    uint32_t symbol_size = 0;
+    uint32_t symbol_size = n_leading;
     for (uint32_t i = 0; i < curve_size; i++)
     {
         // check if need to reallocate memory for the curve
-        increase_allocated_curve_memory_check(symbol_size, &allocated_curve_memory, (*curve_symbol_word));
+        if (!increase_allocated_curve_memory_check(symbol_size, &allocated_curve_memory, curve_symbol_word))
+        {
+            return ESP_ERR_NO_MEM;
+        }
 
         // check if the duration exceeds 0x8000 (2^15 not uint16_t!! RMT symbol word size is 15bits)
         uint8_t n_shifts = 1;
@@ -108,7 +552,7 @@ void esp32s3_stepper_curve_to_rmt_symbol(uint32_t* curve, uint32_t curve_size, r
             {
                 big_symbol = curve[i] >> (k + 1);
 
-                if (big_symbol <= (uint32_t) 0x8000)
+                if (big_symbol < (uint32_t) 0x8000)     // 0x8000 would read as 0, the RMT end marker
                 {
                     n_shifts = k;
                     break;
@@ -120,7 +564,10 @@ void esp32s3_stepper_curve_to_rmt_symbol(uint32_t* curve, uint32_t curve_size, r
 
             for (uint8_t j = 0; j < 1 << (n_shifts - 1); j++)
             {   
-                increase_allocated_curve_memory_check(symbol_size, &allocated_curve_memory, (*curve_symbol_word));
+                if (!increase_allocated_curve_memory_check(symbol_size, &allocated_curve_memory, curve_symbol_word))
+                {
+                    return ESP_ERR_NO_MEM;
+                }
 
                 (*curve_symbol_word)[symbol_size].level0 = 1;
                 (*curve_symbol_word)[symbol_size].duration0 = symbol_duration;
@@ -131,7 +578,10 @@ void esp32s3_stepper_curve_to_rmt_symbol(uint32_t* curve, uint32_t curve_size, r
             }
             for (uint8_t j = 0; j < 1 << (n_shifts - 1); j++)
             {
-                increase_allocated_curve_memory_check(symbol_size, &allocated_curve_memory, (*curve_symbol_word));
+                if (!increase_allocated_curve_memory_check(symbol_size, &allocated_curve_memory, curve_symbol_word))
+                {
+                    return ESP_ERR_NO_MEM;
+                }
 
                 (*curve_symbol_word)[symbol_size].level0 = 0;
                 (*curve_symbol_word)[symbol_size].duration0 = symbol_duration;
@@ -143,8 +593,6 @@ void esp32s3_stepper_curve_to_rmt_symbol(uint32_t* curve, uint32_t curve_size, r
         }
         else
         {
-            increase_allocated_curve_memory_check(symbol_size, &allocated_curve_memory, (*curve_symbol_word));
-
             uint16_t symbol_duration = (uint16_t) curve[i] >> 1; // divide timestep by 2 to create one step pulse
             // FIXME: for duration that exceeds 0xFFFF, split the duration into multiple symbols
             (*curve_symbol_word)[symbol_size].level0 = 1;
@@ -156,77 +604,380 @@ void esp32s3_stepper_curve_to_rmt_symbol(uint32_t* curve, uint32_t curve_size, r
         }
     }
 
-    printf("curve_symbol_word[0].duration0: %d\n", (*curve_symbol_word)[0].duration0);
-
-    // shrink the curve memory to the actual size
-    (*curve_symbol_word) = (rmt_symbol_word_t*) realloc((*curve_symbol_word), symbol_size * sizeof(rmt_symbol_word_t));
-    printf("after relloc curve_symbol_word[0].duration0: %d\n", (*curve_symbol_word)[0].duration0);
+    // shrink the curve memory to the actual size, the larger block is kept if that fails
+    rmt_symbol_word_t* shrunk = (rmt_symbol_word_t*) heap_caps_realloc((*curve_symbol_word), (symbol_size > 0 ? symbol_size : 1) * sizeof(rmt_symbol_word_t), ESP32S3_RMT_MALLOC_CAPS);
+    if (shrunk != NULL)
+    {
+        (*curve_symbol_word) = shrunk;
+    }
 
     printf("symbol size: %ld\n", symbol_size);
     *curve_symbol_word_size = symbol_size;
+
+    return ESP_OK;
 }
 
 
 
 /**
- * @brief Encode the user data into RMT symbols
+ * @brief Build RMT symbols that hold a constant level for a duration, e.g. the DIR signal or an idle gap
  * 
- * @param primary_data not using this parameter to pass the user data from rmt_transmit().
- *                     Instead, using esp32s3_rmt_curve_encoder_t *stepper_encoder = __containerof(encoder, esp32s3_rmt_curve_encoder_t, base);
- *                     to access the user data stored in esp32s3_rmt_curve_encoder_t
+ * @param level output level
+ * @param duration [us] total duration, 0x7FFF at most per symbol half
+ * @param symbols allocated symbols, to be freed by the caller
+ * @param n_symbols number of symbols
  */
-static size_t esp32s3_rmt_encode_stepper_curve(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *primary_data, size_t data_size, rmt_encode_state_t *ret_state)
-{   
-    esp32s3_rmt_curve_encoder_t *stepper_encoder = __containerof(encoder, esp32s3_rmt_curve_encoder_t, base);
-    rmt_encoder_handle_t copy_encoder = stepper_encoder->copy_encoder;
-    rmt_encode_state_t session_state = RMT_ENCODING_RESET;
-    size_t encoded_symbols = 0;
+void esp32s3_level_to_rmt_symbol(uint8_t level, uint32_t duration, rmt_symbol_word_t **symbols, uint32_t *n_symbols)
+{
+    const uint32_t max_symbol_duration = 2 * 0x7FFF;
+    uint32_t symbol_size = (duration + max_symbol_duration - 1) / max_symbol_duration;
 
-    encoded_symbols = copy_encoder->encode(copy_encoder,
-                                           channel,
-                                           stepper_encoder->curve_symbols,
-                                           stepper_encoder->n_symbols * sizeof(rmt_symbol_word_t),
-                                           &session_state);
+    (*symbols) = esp32s3_rmt_alloc_symbols(symbol_size);
 
-    *ret_state = session_state;
-    printf("Encoded symbols: %d\n", encoded_symbols);
-    return encoded_symbols;
+    for (uint32_t i = 0; i < symbol_size; i++)
+    {
+        uint32_t symbol_duration = (duration > max_symbol_duration) ? max_symbol_duration : duration;
+        duration -= symbol_duration;
+
+        // NOTE: a zero duration1 ends the transmission, only possible for the last symbol of an odd 1 us remainder
+        (*symbols)[i].level0 = level;
+        (*symbols)[i].duration0 = symbol_duration - symbol_duration / 2;
+        (*symbols)[i].level1 = level;
+        (*symbols)[i].duration1 = symbol_duration / 2;
+    }
+
+    *n_symbols = symbol_size;
 }
 
 
-static esp_err_t esp32s3_rmt_del_stepper_curve_encoder(rmt_encoder_t *encoder)
+/**
+ * @brief Total duration [us] of RMT symbols
+ */
+uint32_t esp32s3_rmt_symbol_duration(const rmt_symbol_word_t *symbols, uint32_t n_symbols)
 {
-    esp32s3_rmt_curve_encoder_t *stepper_encoder = __containerof(encoder, esp32s3_rmt_curve_encoder_t, base);
-    rmt_del_encoder(stepper_encoder->copy_encoder);
-    free(stepper_encoder->curve_symbols);
-    free(stepper_encoder);
+    uint32_t duration = 0;
 
-    return ESP_OK;
+    for (uint32_t i = 0; i < n_symbols; i++)
+    {
+        duration += symbols[i].duration0 + symbols[i].duration1;
+    }
+
+    return duration;
 }
 
 
-static esp_err_t esp32s3_rmt_reset_stepper_curve_encoder(rmt_encoder_t *encoder)
+static bool ESP32S3_RMT_ISR_ATTR esp32s3_rmt_tx_done_callback(rmt_channel_handle_t channel, const rmt_tx_done_event_data_t *edata, void *user_data)
 {
-    esp32s3_rmt_curve_encoder_t *stepper_encoder = __containerof(encoder, esp32s3_rmt_curve_encoder_t, base);
-    rmt_encoder_reset(stepper_encoder->copy_encoder);
-    return ESP_OK;
+    esp32s3_rmt_tx_queue_t* tx_queue = (esp32s3_rmt_tx_queue_t*) user_data;
+    esp32s3_rmt_telemetry_t* telemetry = &tx_queue->telemetry;
+    uint32_t n_done = tx_queue->n_done;
+
+    portENTER_CRITICAL_ISR(&tx_queue->lock);
+    esp32s3_rmt_write_telemetry_begin(telemetry);
+
+    const esp32s3_rmt_trans_info_t* done_info = &tx_queue->info[n_done % ESP32S3_RMT_TRANS_QUEUE_DEPTH];
+    telemetry->position += done_info->steps;
+    telemetry->symbols_sent += edata->num_symbols;
+    telemetry->time_base = esp_timer_get_time();
+    telemetry->n_anchors = 0;
+
+    // the next queued transaction starts right away
+    if (tx_queue->n_queued - n_done > 1)
+    {
+        telemetry->active = tx_queue->info[(n_done + 1) % ESP32S3_RMT_TRANS_QUEUE_DEPTH];
+    }
+    else
+    {
+        telemetry->active = (esp32s3_rmt_trans_info_t) {0};
+    }
+
+    esp32s3_rmt_write_telemetry_end(telemetry);
+
+    // transactions of a channel are done in order, the task side frees the buffers of the done ones
+    tx_queue->n_done = n_done + 1;
+    portEXIT_CRITICAL_ISR(&tx_queue->lock);
+
+    return false;   // no high priority task woken
+}
+
+
+/**
+ * @brief Simple encoder callback: copy the payload symbols scaled by the feed rate. A scaled symbol can need several
+ *        symbols (durations above 0x7FFF), they are kept in the scratch until the RMT memory has room.
+ *        The first n_unscaled symbols of the transaction info are copied as they are, without advancing the ramp.
+ *        The output and nominal time of the symbols written so far are published in the telemetry after every refill,
+ *        see esp32s3_rmt_nominal_elapsed().
+ *        NOTE: ISR context, fixed point only (no FPU in ISR). Also called from the task of an idle channel's transmit.
+ */
+static size_t ESP32S3_RMT_ISR_ATTR esp32s3_rmt_encode_feed_rate_symbols(const void *data, size_t data_size, size_t symbols_written, size_t symbols_free, rmt_symbol_word_t *symbols, bool *done, void *arg)
+{
+    esp32s3_rmt_tx_queue_t* tx_queue = (esp32s3_rmt_tx_queue_t*) arg;
+    esp32s3_rmt_feed_rate_t* feed_rate = &tx_queue->feed_rate;
+    const rmt_symbol_word_t* payload = (const rmt_symbol_word_t*) data;
+    uint32_t n_payload = data_size / sizeof(rmt_symbol_word_t);
+    size_t n_written = 0;
+
+    if (symbols_written == 0)
+    {
+        // new transaction, the tx done ISR has already counted the previous one done
+        feed_rate->symbol_idx = 0;
+        feed_rate->scratch_idx = 0;
+        feed_rate->scratch_size = 0;
+        feed_rate->n_unscaled = tx_queue->info[tx_queue->n_done % ESP32S3_RMT_TRANS_QUEUE_DEPTH].n_unscaled;
+        feed_rate->encoded_output = 0;
+        feed_rate->encoded_nominal = 0;
+    }
+
+    while (n_written < symbols_free)
+    {
+        if (feed_rate->scratch_idx == feed_rate->scratch_size)
+        {
+            if (feed_rate->symbol_idx == n_payload)
+            {
+                break;
+            }
+
+            rmt_symbol_word_t symbol = payload[feed_rate->symbol_idx];
+            feed_rate->scratch_nominal = symbol.duration0 + symbol.duration1;
+
+            if (feed_rate->symbol_idx < feed_rate->n_unscaled)
+            {
+                feed_rate->scratch[0] = symbol;
+                feed_rate->scratch_idx = 0;
+                feed_rate->scratch_size = 1;
+            }
+            else
+            {
+                esp32s3_rmt_scale_symbol(feed_rate, symbol);
+            }
+            feed_rate->symbol_idx++;
+        }
+
+        rmt_symbol_word_t written = feed_rate->scratch[feed_rate->scratch_idx++];
+        symbols[n_written++] = written;
+
+        feed_rate->encoded_output += written.duration0 + written.duration1;
+        if (feed_rate->scratch_idx == feed_rate->scratch_size)
+        {
+            feed_rate->encoded_nominal += feed_rate->scratch_nominal;
+        }
+    }
+
+    if (n_written > 0)
+    {
+        esp32s3_rmt_telemetry_t* telemetry = &tx_queue->telemetry;
+
+        portENTER_CRITICAL_SAFE(&tx_queue->lock);
+        esp32s3_rmt_write_telemetry_begin(telemetry);
+        telemetry->anchors[telemetry->n_anchors % ESP32S3_RMT_TIME_ANCHORS] = (esp32s3_rmt_time_anchor_t) {
+            .output = feed_rate->encoded_output,
+            .nominal = feed_rate->encoded_nominal,
+        };
+        telemetry->n_anchors++;
+        esp32s3_rmt_write_telemetry_end(telemetry);
+        portEXIT_CRITICAL_SAFE(&tx_queue->lock);
+    }
+
+    *done = (feed_rate->scratch_idx == feed_rate->scratch_size && feed_rate->symbol_idx == n_payload);
+    return n_written;
+}
+
+
+/**
+ * @brief Scale the durations of a symbol by 1 / feed rate into the scratch, split into several symbols if needed.
+ */
+static void ESP32S3_RMT_ISR_ATTR esp32s3_rmt_scale_symbol(esp32s3_rmt_feed_rate_t* feed_rate, rmt_symbol_word_t symbol)
+{
+    // [Q16] 1 / feed rate, rounded 2^32 / rate with 32 bit divisions
+    uint32_t rate = feed_rate->rate;
+    uint32_t period_scale = UINT32_MAX / rate + ((UINT32_MAX % rate) + 1 + rate / 2) / rate;
+    uint32_t duration0 = esp32s3_rmt_scale_duration(feed_rate, symbol.duration0, period_scale);
+    uint32_t duration1 = esp32s3_rmt_scale_duration(feed_rate, symbol.duration1, period_scale);
+
+    feed_rate->scratch_idx = 0;
+
+    if (duration0 <= 0x7FFF && duration1 <= 0x7FFF)
+    {
+        feed_rate->scratch[0].level0 = symbol.level0;
+        feed_rate->scratch[0].duration0 = duration0;
+        feed_rate->scratch[0].level1 = symbol.level1;
+        feed_rate->scratch[0].duration1 = duration1;
+        feed_rate->scratch_size = 1;
+    }
+    else
+    {
+        // split each level into pieces of 0x7FFF at most, then pack the pieces in pairs
+        uint16_t pieces[2 * ESP32S3_RMT_FEED_RATE_SCRATCH];
+        uint8_t levels[2 * ESP32S3_RMT_FEED_RATE_SCRATCH];
+        uint8_t n_pieces = 0;
+        uint32_t durations[2] = {duration0, duration1};
+        uint8_t symbol_levels[2] = {symbol.level0, symbol.level1};
+
+        for (uint8_t h = 0; h < 2; h++)
+        {
+            uint32_t n = (durations[h] + 0x7FFE) / 0x7FFF;
+            for (uint32_t k = 0; k < n; k++)
+            {
+                pieces[n_pieces] = durations[h] / n + ((k < durations[h] % n) ? 1 : 0);
+                levels[n_pieces] = symbol_levels[h];
+                n_pieces++;
+            }
+        }
+
+        if (n_pieces & 1)
+        {
+            // odd number of pieces: halve the longest one (> 0x3FFF), no zero duration within the stream
+            uint8_t longest = 0;
+            for (uint8_t k = 1; k < n_pieces; k++)
+            {
+                longest = (pieces[k] > pieces[longest]) ? k : longest;
+            }
+
+            for (uint8_t k = n_pieces; k > longest + 1; k--)
+            {
+                pieces[k] = pieces[k - 1];
+                levels[k] = levels[k - 1];
+            }
+            pieces[longest + 1] = pieces[longest] / 2;
+            levels[longest + 1] = levels[longest];
+            pieces[longest] -= pieces[longest + 1];
+            n_pieces++;
+        }
+
+        feed_rate->scratch_size = n_pieces / 2;
+        for (uint8_t k = 0; k < feed_rate->scratch_size; k++)
+        {
+            feed_rate->scratch[k].level0 = levels[2 * k];
+            feed_rate->scratch[k].duration0 = pieces[2 * k];
+            feed_rate->scratch[k].level1 = levels[2 * k + 1];
+            feed_rate->scratch[k].duration1 = pieces[2 * k + 1];
+        }
+    }
+
+    esp32s3_rmt_update_feed_rate(feed_rate, duration0 + duration1);
 }
 
 
-static void esp32s3_rmt_tx_done_callback(rmt_channel_handle_t channel, const rmt_tx_done_event_data_t *edata, void *user_data)
+/**
+ * @brief [us] duration scaled by period_scale [Q16], the rounding remainder is carried over so the stream does not drift.
+ *        0 (end marker) stays 0, other durations are 1 us at least.
+ */
+static uint32_t ESP32S3_RMT_ISR_ATTR esp32s3_rmt_scale_duration(esp32s3_rmt_feed_rate_t* feed_rate, uint32_t duration, uint32_t period_scale)
 {
-    // TODO
+    if (duration == 0)
+    {
+        return 0;
+    }
 
-    printf("RMT channel transmission done naniiii\n");
+    uint64_t scaled = (uint64_t) duration * period_scale + feed_rate->residual;
+    feed_rate->residual = (uint32_t) (scaled & 0xFFFF);
+    uint32_t scaled_duration = (uint32_t) (scaled >> 16);
+
+    return (scaled_duration > 0) ? scaled_duration : 1;
 }
 
 
-static void increase_allocated_curve_memory_check(uint32_t current_size, uint32_t* current_max_size, rmt_symbol_word_t *curve)
+/**
+ * @brief Advance the feed rate ramp by output_duration [us] of output.
+ *        Minimum jerk smoothstep s(u) = 10u^3 - 15u^4 + 6u^5: zero rate of change and acceleration at both ends.
+ */
+static void ESP32S3_RMT_ISR_ATTR esp32s3_rmt_update_feed_rate(esp32s3_rmt_feed_rate_t* feed_rate, uint32_t output_duration)
+{
+    uint32_t target = __atomic_load_n(&feed_rate->target, __ATOMIC_ACQUIRE);
+
+    if (target != feed_rate->ramp_to)
+    {
+        // new request, also in the middle of a ramp: start from the current feed rate
+        feed_rate->ramp_from = feed_rate->rate;
+        feed_rate->ramp_to = target;
+        feed_rate->ramp_length = feed_rate->ramp_duration;
+        feed_rate->ramp_inverse = feed_rate->ramp_duration_inverse;
+        feed_rate->ramp_elapsed = 0;
+    }
+
+    if (feed_rate->rate == feed_rate->ramp_to)
+    {
+        return;
+    }
+
+    feed_rate->ramp_elapsed += output_duration;
+    if (feed_rate->ramp_elapsed >= feed_rate->ramp_length)
+    {
+        feed_rate->rate = feed_rate->ramp_to;
+        return;
+    }
+
+    // [Q16] ramp progress
+    int64_t u = ((uint64_t) feed_rate->ramp_elapsed * feed_rate->ramp_inverse) >> 16;
+    u = (u > 0x10000) ? 0x10000 : u;
+
+    int64_t u2 = (u * u) >> 16;
+    int64_t u3 = (u2 * u) >> 16;
+    int64_t smoothstep = (u3 * ((10 << 16) - 15 * u + 6 * u2)) >> 16;
+
+    feed_rate->rate = (uint32_t) ((int64_t) feed_rate->ramp_from + ((((int64_t) feed_rate->ramp_to - feed_rate->ramp_from) * smoothstep) >> 16));
+}
+
+
+/**
+ * @brief Seqlock write: readers retry while the sequence number is odd or has changed. One writer at a time.
+ */
+static void ESP32S3_RMT_ISR_ATTR esp32s3_rmt_write_telemetry_begin(esp32s3_rmt_telemetry_t* telemetry)
+{
+    __atomic_store_n(&telemetry->seq, telemetry->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+
+static void ESP32S3_RMT_ISR_ATTR esp32s3_rmt_write_telemetry_end(esp32s3_rmt_telemetry_t* telemetry)
+{
+    __atomic_store_n(&telemetry->seq, telemetry->seq + 1, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * @brief [us] from the rising edge of the symbol half to the next rising edge (or the end of the symbols), i.e. the
+ *        time step of that step, split symbols included.
+ */
+static uint32_t esp32s3_rmt_step_period(const rmt_symbol_word_t* symbols, uint32_t n_halves, uint32_t half)
+{
+    uint32_t period = 0;
+    uint8_t level = 1;
+
+    for (uint32_t h = half; h < n_halves; h++)
+    {
+        rmt_symbol_word_t symbol = symbols[h / 2];
+        uint8_t half_level = (h & 1) ? symbol.level1 : symbol.level0;
+
+        if (half_level && !level)
+        {
+            break;
+        }
+
+        period += (h & 1) ? symbol.duration1 : symbol.duration0;
+        level = half_level;
+    }
+
+    return period;
+}
+
+
+static bool increase_allocated_curve_memory_check(uint32_t current_size, uint32_t* current_max_size, rmt_symbol_word_t **curve)
 {
     if (current_size >= *current_max_size)
     {
-        curve = (rmt_symbol_word_t*) realloc(curve, 2 * (*current_max_size) * sizeof(rmt_symbol_word_t));
+        rmt_symbol_word_t* grown = (rmt_symbol_word_t*) heap_caps_realloc(*curve, 2 * (*current_max_size) * sizeof(rmt_symbol_word_t), ESP32S3_RMT_MALLOC_CAPS);
+        if (grown == NULL)
+        {
+            // the curve is dropped
+            free(*curve);
+            *curve = NULL;
+            return false;
+        }
 
+        *curve = grown;
         *current_max_size = 2 * (*current_max_size);
     }
+
+    return true;
 }
\ No newline at end of file
@@ -5,29 +5,143 @@
 extern "C" {
 #endif
 
+#include <sdkconfig.h>
+#include <esp_attr.h>
+#include <esp_heap_caps.h>
 #include <driver/rmt_tx.h>
+#include <freertos/FreeRTOS.h>
 
 
-typedef struct esp32s3_rmt_encoder_data {
-    rmt_channel_handle_t rmt_channel;
-    rmt_encoder_handle_t rmt_encoder;
-    rmt_symbol_word_t* symbols;         
-    uint32_t n_symbols;     
-} esp32s3_rmt_encoder_data_t;
+#define ESP32S3_RMT_TRANS_QUEUE_DEPTH 10
 
+#define ESP32S3_RMT_FEED_RATE_ONE       (1 << 16)   // Q16 feed rate of 100%
+#define ESP32S3_RMT_FEED_RATE_MIN       (ESP32S3_RMT_FEED_RATE_ONE / 10)    // 10%, time steps are stretched 10 times at most
+#define ESP32S3_RMT_FEED_RATE_MAX       (2 * ESP32S3_RMT_FEED_RATE_ONE)     // 200%
+#define ESP32S3_RMT_FEED_RATE_SCRATCH   12          // symbols of one stretched symbol: 2 * 10 durations of 0x7FFF at most, + 1 split
+#define ESP32S3_RMT_TIME_ANCHORS        4           // last encoder refills kept in the telemetry, the RMT memory holds 2 refills ahead of the output
+
+// IRAM-safe mode (menuconfig, needs CONFIG_RMT_ISR_IRAM_SAFE): the encoder and tx done ISR path run from IRAM and only
+// touch internal DRAM, so the RMT refills keep going while the flash cache is disabled (flash/NVS writes, Wi-Fi, BT)
+#if CONFIG_NO_JERKY_ISR_IRAM_SAFE
+#define ESP32S3_RMT_ISR_ATTR IRAM_ATTR
+#define ESP32S3_RMT_MALLOC_CAPS (MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT)
+#else
+#define ESP32S3_RMT_ISR_ATTR
+#define ESP32S3_RMT_MALLOC_CAPS MALLOC_CAP_DEFAULT
+#endif
+
+
+typedef struct esp32s3_rmt_trans_info {
+    int32_t steps;                      // signed number of steps of the transaction
+    uint32_t duration;                  // [us] duration of the transaction
+    uint32_t move_steps;                // steps of the whole move the transaction is part of, 0 if not a move
+    uint32_t move_step_offset;          // steps of that move before this transaction
+    uint8_t eot_level;                  // output level once the transaction is done
+    uint8_t n_unscaled;                 // leading symbols copied as they are by the feed rate encoder (DIR setup gap)
+    const rmt_symbol_word_t* symbols;   // symbols as queued (not scaled by the feed rate), set by esp32s3_rmt_transmit()
+    uint32_t n_symbols;
+} esp32s3_rmt_trans_info_t;
+
+
+typedef struct esp32s3_rmt_start_stats {
+    uint32_t count;                     // number of deadline starts
+    uint32_t failed;                    // deadline starts that could not be queued (channel busy, RMT error)
+    int32_t min_error;                  // [us] first STEP rising edge - deadline, measured in a GPIO ISR
+    int32_t max_error;                  // [us]
+    int64_t sum_error;                  // [us] sum_error / count = mean start error (latency)
+} esp32s3_rmt_start_stats_t;
+
+
+typedef struct esp32s3_rmt_time_anchor {
+    // end of an encoder refill of the active transaction, the output has no gaps: output [us] is also its time stamp
+    // from the telemetry time_base
+    uint32_t output;                    // [us] output time of the symbols encoded so far
+    uint32_t nominal;                   // [us] nominal time (100% feed rate, setup gap unscaled) of the same symbols
+} esp32s3_rmt_time_anchor_t;
 
-// public functions
-rmt_channel_handle_t esp32s3_rmt_init(uint8_t step_pin);
-esp_err_t esp32s3_rmt_new_stepper_curve_encoder(esp32s3_rmt_encoder_data_t *encoder_data);
-void esp32s3_stepper_curve_to_rmt_symbol(uint32_t* curve, uint32_t curve_size, rmt_symbol_word_t **curve_symbol_word, uint32_t *curve_symbol_word_size);
 
+typedef struct esp32s3_rmt_telemetry {
+    volatile uint32_t seq;              // seqlock sequence number, odd while the telemetry is being written
+    int32_t position;                   // [steps] once the done transactions are output
+    uint32_t symbols_sent;              // number of symbols of the done transactions
+    int64_t time_base;                  // [us] esp_timer time the active transaction started, or the last one was done if idle
+    esp32s3_rmt_trans_info_t active;    // transaction being output, all zero if idle
+    esp32s3_rmt_start_stats_t start_stats;
+    uint32_t n_anchors;                 // encoder refills of the active transaction, 0 if not feed rate encoded
+    esp32s3_rmt_time_anchor_t anchors[ESP32S3_RMT_TIME_ANCHORS];  // the last ones, anchor k in anchors[k % ESP32S3_RMT_TIME_ANCHORS]
+} esp32s3_rmt_telemetry_t;
 
-// static functions
-static size_t esp32s3_rmt_encode_stepper_curve(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *primary_data, size_t data_size, rmt_encode_state_t *ret_state);
-static esp_err_t esp32s3_rmt_del_stepper_curve_encoder(rmt_encoder_t *encoder);
-static esp_err_t esp32s3_rmt_reset_stepper_curve_encoder(rmt_encoder_t *encoder);
-static void esp32s3_rmt_tx_done_callback(rmt_channel_handle_t channel, const rmt_tx_done_event_data_t *edata, void *user_data);
-static void increase_allocated_curve_memory_check(uint32_t current_size, uint32_t* current_max_size, rmt_symbol_word_t *curve);
+
+typedef struct esp32s3_rmt_symbol_cursor {
+    // position of a walk through the symbols of the active transaction, see esp32s3_rmt_walk_active_steps()
+    const rmt_symbol_word_t* symbols;   // symbols and start time of the transaction walked
+    int64_t time_base;
+    uint32_t half;                      // next symbol half (2 per symbol)
+    uint32_t elapsed;                   // [us] nominal time at the start of that half
+    uint32_t steps;                     // rising edges before that half
+    uint32_t step_period;               // [us] nominal period of the last step, from its rising edge to the next one
+    uint8_t level;                      // output level before that half
+} esp32s3_rmt_symbol_cursor_t;
+
+
+typedef struct esp32s3_rmt_feed_rate {
+    volatile uint32_t target;           // [Q16] requested feed rate, set by esp32s3_rmt_set_feed_rate()
+    volatile uint32_t ramp_duration;    // [us] of the ramp to the requested feed rate
+    volatile uint32_t ramp_duration_inverse;    // [Q32 1/us]
+    volatile uint32_t rate;             // [Q16] feed rate of the symbols being encoded
+
+    // ramp and encoding state, encoder ISR only
+    uint32_t ramp_from;                 // [Q16]
+    uint32_t ramp_to;                   // [Q16]
+    uint32_t ramp_length;               // [us]
+    uint32_t ramp_inverse;              // [Q32 1/us]
+    uint32_t ramp_elapsed;              // [us] of output since the start of the ramp
+    uint32_t residual;                  // [Q16 us] rounding remainder carried to the next duration, no drift
+    uint32_t symbol_idx;                // next symbol of the payload to scale
+    uint8_t n_unscaled;                 // leading symbols of the transaction being encoded not to scale
+    uint32_t encoded_output;            // [us] output time of the symbols written to the RMT memory in this transaction
+    uint32_t encoded_nominal;           // [us] nominal time of the payload symbols written
+    uint32_t scratch_nominal;           // [us] nominal time of the payload symbol in the scratch
+    rmt_symbol_word_t scratch[ESP32S3_RMT_FEED_RATE_SCRATCH];   // scaled symbols not written to the RMT memory yet
+    uint8_t scratch_size;
+    uint8_t scratch_idx;
+} esp32s3_rmt_feed_rate_t;
+
+
+typedef struct esp32s3_rmt_tx_queue {
+    rmt_encoder_handle_t copy_encoder;  // encoder of the owned symbols, one per channel
+    rmt_encoder_handle_t feed_rate_encoder;     // same as copy_encoder, with the durations scaled by the feed rate
+    esp32s3_rmt_feed_rate_t feed_rate;
+    volatile uint32_t n_queued;         // number of transactions queued
+    volatile uint32_t n_done;           // number of transactions done, updated from the tx done ISR
+    uint32_t n_released;                // number of done transactions whose symbols are freed
+    void* buffers[ESP32S3_RMT_TRANS_QUEUE_DEPTH];   // buffers owned by the queued transactions
+    esp32s3_rmt_trans_info_t info[ESP32S3_RMT_TRANS_QUEUE_DEPTH];   // steps and duration of the queued transactions
+    int8_t direction;                   // sign of the steps of the next transactions, +1 (DIR high) or -1
+    portMUX_TYPE lock;                  // serialises the telemetry writers: the tx done ISR and the transmit of an idle channel
+    esp32s3_rmt_telemetry_t telemetry;  // read lock-free with esp32s3_rmt_read_telemetry()
+    portMUX_TYPE cursor_lock;           // guards the copies in and out of cursor, not the walks
+    esp32s3_rmt_symbol_cursor_t cursor; // furthest walk through the active transaction
+} esp32s3_rmt_tx_queue_t;
+
+
+// public functions
+rmt_channel_handle_t esp32s3_rmt_init(uint8_t step_pin, esp32s3_rmt_tx_queue_t** tx_queue);
+esp_err_t esp32s3_stepper_curve_to_rmt_symbol(uint32_t* curve, uint32_t curve_size, uint32_t n_leading, rmt_symbol_word_t **curve_symbol_word, uint32_t *curve_symbol_word_size);
+void esp32s3_level_to_rmt_symbol(uint8_t level, uint32_t duration, rmt_symbol_word_t **symbols, uint32_t *n_symbols);
+uint32_t esp32s3_rmt_symbol_duration(const rmt_symbol_word_t *symbols, uint32_t n_symbols);
+esp_err_t esp32s3_rmt_transmit(rmt_channel_handle_t rmt_channel, esp32s3_rmt_tx_queue_t* tx_queue, rmt_encoder_handle_t encoder, const void* payload, size_t payload_bytes, void* owned_buffer, const esp32s3_rmt_trans_info_t* info);
+void esp32s3_rmt_release_done_buffers(esp32s3_rmt_tx_queue_t* tx_queue);
+void esp32s3_rmt_set_feed_rate(esp32s3_rmt_tx_queue_t* tx_queue, uint32_t feed_rate, uint32_t ramp_duration);
+void esp32s3_rmt_read_telemetry(const esp32s3_rmt_tx_queue_t* tx_queue, esp32s3_rmt_telemetry_t* telemetry);
+void esp32s3_rmt_record_start_error(esp32s3_rmt_tx_queue_t* tx_queue, int32_t error);
+void esp32s3_rmt_record_start_failure(esp32s3_rmt_tx_queue_t* tx_queue);
+uint32_t esp32s3_rmt_nominal_elapsed(const esp32s3_rmt_telemetry_t* telemetry, int64_t now, uint32_t* feed_rate);
+bool esp32s3_rmt_walk_active_steps(esp32s3_rmt_tx_queue_t* tx_queue, const esp32s3_rmt_telemetry_t* telemetry, uint32_t elapsed, uint32_t* steps, uint32_t* step_period);
+rmt_symbol_word_t* esp32s3_rmt_alloc_symbols(uint32_t n_symbols);
+uint32_t esp32s3_rmt_count_steps(const rmt_symbol_word_t *symbols, uint32_t n_symbols);
+void esp32s3_route_output_signal(uint8_t source_pin, uint8_t follower_pin, bool invert);
+rmt_sync_manager_handle_t esp32s3_rmt_new_sync_manager(rmt_channel_handle_t* rmt_channels, uint8_t n_channels);
 
 #ifdef __cplusplus
 }
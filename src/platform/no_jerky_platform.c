@@ -5,156 +5,837 @@
 #include <freertos/FreeRTOS.h>  // IMPORTANT: make sure CONFIG_FREERTOS_HZ=1000 for correct timing
 #include <driver/gpio.h>
 #include <esp_check.h>
+#include <esp_rom_sys.h>
+#include <esp_partition.h>
+#include <esp_timer.h>
+#include <soc/soc_caps.h>
+#include <hal/gpio_ll.h>
 #include <string.h>
 
 #include "no_jerky_platform.h"
+#include "mjt.h"
+
+
+// static functions
+static void transmit_not_jerky_step_symbols(no_jerky_output_t output_ch, const rmt_symbol_word_t* symbols, uint32_t n_symbols, rmt_symbol_word_t* owned_buffer, const esp32s3_rmt_trans_info_t* info, uint8_t dir_level);
+static uint8_t current_not_jerky_dir_level(no_jerky_output_t output_ch);
+static void set_not_jerky_dir_level(no_jerky_output_t output_ch, uint8_t level);
+static void no_jerky_scheduled_start_callback(void* arg);
+static void no_jerky_first_step_edge_isr(void* arg);
+static esp_err_t add_no_jerky_first_step_edge_isr(no_jerky_scheduled_start_t* start);
+static esp_err_t no_jerky_program_esp_err(no_jerky_program_err_t program_err);
+static rmt_sync_manager_handle_t new_no_jerky_program_sync_manager(const no_jerky_output_t* outputs, uint8_t n_outputs);
+static esp32s3_rmt_trans_info_t motion_curve_trans_info(no_jerky_output_t output_ch, const rmt_symbol_word_t* symbols, uint32_t n_symbols, uint32_t move_steps, uint32_t* move_step_offset);
+
+
+// idle STEP of an axis without symbols in a segment of a synced motion program
+static const rmt_symbol_word_t no_jerky_program_idle_symbol = {
+    .level0 = 0,
+    .duration0 = 1,
+    .level1 = 0,
+    .duration1 = 1,
+};
 
 
 no_jerky_output_t no_jerky_init(no_jerky_motor_pins_t motor_pins)
 {
     no_jerky_output_t output_ch;
 
-    // configure motor pins
-    gpio_set_direction((gpio_num_t) motor_pins.dir, GPIO_MODE_OUTPUT);
+    // configure motor pins - DIR is read back to skip the direction change when it is already set
+    gpio_set_direction((gpio_num_t) motor_pins.dir, GPIO_MODE_INPUT_OUTPUT);
     gpio_set_direction((gpio_num_t) motor_pins.step, GPIO_MODE_OUTPUT);
 
     gpio_set_level((gpio_num_t) motor_pins.dir, 1);
 
     // configure ESP32-S3 RMT channels
-    output_ch.rmt_channel = esp32s3_rmt_init(motor_pins.step);
+    output_ch.rmt_channel = esp32s3_rmt_init(motor_pins.step, &output_ch.tx_queue);
+
+    output_ch.step_pin = motor_pins.step;
+    output_ch.dir_pin = motor_pins.dir;
+    output_ch.dir_channel = NULL;
+    output_ch.dir_tx_queue = NULL;
+    output_ch.sync_manager = NULL;
+    output_ch.followers = (no_jerky_followers_t*) calloc(1, sizeof(no_jerky_followers_t));
+
+    // deadline start: the timer callback runs in the esp_timer task (highest priority)
+    output_ch.scheduled_start = (no_jerky_scheduled_start_t*) calloc(1, sizeof(no_jerky_scheduled_start_t));
+    output_ch.scheduled_start->rmt_channel = output_ch.rmt_channel;
+    output_ch.scheduled_start->tx_queue = output_ch.tx_queue;
+    output_ch.scheduled_start->step_pin = motor_pins.step;
+
+    esp_timer_create_args_t start_timer_args = {
+        .callback = no_jerky_scheduled_start_callback,
+        .arg = output_ch.scheduled_start,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "no_jerky_start",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&start_timer_args, &output_ch.start_timer));
 
     return output_ch;
 }
 
 
-void output_not_jerky_motion_curve(no_jerky_output_t output_ch, uint32_t *curve, uint32_t curve_size)
+/**
+ * @brief Same as no_jerky_init(), but DIR is driven by a second RMT channel synchronised with the STEP channel.
+ *        Direction changes are then scheduled inside the pulse stream by output_not_jerky_signed_motion_curve(), 
+ *        without draining the queue. NOTE: this uses 2 of the 4 ESP32-S3 RMT TX channels.
+ */
+no_jerky_output_t no_jerky_init_with_dir_channel(no_jerky_motor_pins_t motor_pins)
 {
-    // create RMT curve encoder
-    esp32s3_rmt_encoder_data_t encoder_data = {
-        .rmt_channel = output_ch.rmt_channel,
-        .rmt_encoder = NULL,
-        .symbols = NULL,
-        .n_symbols = 0
-    };
+    no_jerky_output_t output_ch = no_jerky_init(motor_pins);
 
-    rmt_transmit_config_t rmt_tx_config = {.loop_count=0};
+    output_ch.dir_channel = esp32s3_rmt_init(motor_pins.dir, &output_ch.dir_tx_queue);
 
-    rmt_symbol_word_t* whole_curve_symbols = NULL;
-    uint32_t whole_curve_symbol_size = 0;
-    // convert curve data into RMT symbol format
-    esp32s3_stepper_curve_to_rmt_symbol(curve, curve_size, &whole_curve_symbols, &whole_curve_symbol_size);
+    rmt_channel_handle_t channels[2] = {output_ch.rmt_channel, output_ch.dir_channel};
+    output_ch.sync_manager = esp32s3_rmt_new_sync_manager(channels, 2);
+
+    return output_ch;
+}
 
-    printf("whole_curve_symbol_size: %ld\n", whole_curve_symbol_size);
-    printf("whole_curve_symbols[0].duration0: %d\n", whole_curve_symbols[0].duration0);
-    if (whole_curve_symbol_size > 48)   // 48 = max memory block size (per channel) for RMT encoder
+
+/**
+ * @brief Attach a motor that runs exactly the same moves as output_ch, e.g. the second motor of a gantry.
+ *        Its STEP pin is driven by the RMT channel of output_ch through the GPIO matrix: the curve is generated, encoded
+ *        and held once, and no RMT channel is used. DIR follows the DIR channel the same way, or is set together with
+ *        the DIR GPIO of output_ch.
+ *        The followers are held behind a pointer shared by every copy of output_ch: copies made before the attach
+ *        (e.g. a no_jerky_stepper_t) run the follower too.
+ * 
+ * @param output_ch leader motor output channel
+ * @param follower_pins pins of the follower motor
+ * @param invert_dir 1 if the follower turns the other way for the same DIR level (mirrored motor)
+ * @return esp_err_t ESP_ERR_NO_MEM if NO_JERKY_MAX_FOLLOWERS are already attached, ESP_OK otherwise
+ */
+esp_err_t attach_not_jerky_follower(no_jerky_output_t* output_ch, no_jerky_motor_pins_t follower_pins, uint8_t invert_dir)
+{
+    no_jerky_followers_t* followers = output_ch->followers;
+
+    if (followers->n >= NO_JERKY_MAX_FOLLOWERS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp32s3_route_output_signal(output_ch->step_pin, follower_pins.step, false);
+
+    if (output_ch->dir_channel != NULL)
+    {
+        esp32s3_route_output_signal(output_ch->dir_pin, follower_pins.dir, invert_dir != 0);
+    }
+    else
     {
-        // divde the curve into 48 symbol chunks - should not be more than uint8_t!?
-        uint8_t n_chunks = whole_curve_symbol_size / 48;
-        uint8_t remainder_chunk = whole_curve_symbol_size % 48;
+        uint8_t dir_level = gpio_get_level((gpio_num_t) output_ch->dir_pin);
+        gpio_set_direction((gpio_num_t) follower_pins.dir, GPIO_MODE_OUTPUT);
+        gpio_set_level((gpio_num_t) follower_pins.dir, dir_level ^ (invert_dir != 0));
+    }
+
+    followers->dir_pins[followers->n] = follower_pins.dir;
+    followers->dir_inverted[followers->n] = (invert_dir != 0);
+    followers->n++;
+
+    return ESP_OK;
+}
 
-        printf("n_chunks: %d, reminder: %d\n", n_chunks, remainder_chunk);
 
-        // allocate memory for the symbols
-        encoder_data.symbols = (rmt_symbol_word_t*) malloc(48 * sizeof(rmt_symbol_word_t));
+/**
+ * @brief Init the parallel bus output: the STEP pins of up to 16 axes are data lines of the LCD_CAM i80 bus.
+ * 
+ * @param motor_pins pins of each axis
+ * @param n_axes number of axes, PARALLEL_STEP_MAX_AXES at most
+ * @param spare_data_pins free GPIOs for the data lines without an axis: 8 - n_axes (n_axes <= 8) or 16 - n_axes. Can be NULL if none
+ * @param pclk_pin free GPIO for the bus clock
+ * @param dc_pin free GPIO for the bus DC line
+ * @return no_jerky_parallel_output_t 
+ */
+no_jerky_parallel_output_t no_jerky_parallel_init(const no_jerky_motor_pins_t* motor_pins, uint8_t n_axes, const uint8_t* spare_data_pins, uint8_t pclk_pin, uint8_t dc_pin)
+{
+    no_jerky_parallel_output_t output;
+    uint8_t data_pins[PARALLEL_STEP_MAX_AXES];
+    uint8_t bus_width = (n_axes <= 8) ? 8 : 16;
 
-        // encode and transmit the first n_chunks
-        for (uint8_t i = 0; i < n_chunks; i++)
+    for (uint8_t i = 0; i < bus_width; i++)
+    {
+        if (i < n_axes)
         {
-            // set the RMT encoder data
-            encoder_data.n_symbols = 48;
+            gpio_set_direction((gpio_num_t) motor_pins[i].dir, GPIO_MODE_INPUT_OUTPUT);
+            gpio_set_level((gpio_num_t) motor_pins[i].dir, 1);
 
-            // copy the curve symbols
-            memcpy(encoder_data.symbols, &whole_curve_symbols[i * 48], 48 * sizeof(rmt_symbol_word_t));
+            data_pins[i] = motor_pins[i].step;
+        }
+        else
+        {
+            data_pins[i] = spare_data_pins[i - n_axes];
+        }
+    }
 
-            printf("copied memory for chunk id: %d\n", i);
+    output.lcd = esp32s3_lcd_parallel_init(data_pins, bus_width, pclk_pin, dc_pin);
+    output.n_axes = n_axes;
 
-            // create new RMT curve encoder
-            ESP_ERROR_CHECK(esp32s3_rmt_new_stepper_curve_encoder(&encoder_data));
-            printf("chunk id: %d encoded\n", i);
+    return output;
+}
+
+
+/**
+ * @brief Output the motion curves of all axes at once: their step schedules are merged into one parallel bit-stream
+ *        that is clocked out over DMA. Blocks until the last part of the bit-stream is queued.
+ * 
+ * @param output parallel output
+ * @param curves [us] time steps of each axis
+ * @param curve_sizes number of steps of each axis
+ */
+void output_not_jerky_parallel_motion_curves(no_jerky_parallel_output_t output, uint32_t* const* curves, const uint32_t* curve_sizes)
+{
+    parallel_step_merger_t merger;
+    init_parallel_step_merger(&merger, curves, curve_sizes, output.n_axes, ESP32S3_LCD_PARALLEL_SAMPLES_PER_US);
 
-            // transmit RMT curve
-            ESP_ERROR_CHECK(rmt_transmit(output_ch.rmt_channel,
-                                        encoder_data.rmt_encoder,
-                                        curve,                      // dummy data
-                                        curve_size,                 // dummy size
-                                        &rmt_tx_config));
+    esp32s3_lcd_parallel_output(output.lcd, &merger);
+}
 
-            printf("chunk id: %d transmitted\n", i);
 
-            // delete RMT curve encoder - free the allocated memory!!
-            encoder_data.rmt_encoder->del(encoder_data.rmt_encoder);
-            // free(encoder_data.symbols);
+/**
+ * @brief Output a motion curve in the current direction. The curve is queued as one transaction that owns its symbols
+ *        (internal DRAM in IRAM-safe mode) until it is done, the refill ISR copies them 24 symbols at a time.
+ *        With a DIR RMT channel, it is paired with a DIR transaction that holds the current level.
+ * 
+ * @param output_ch motor output channel
+ * @param curve [us] time step of each step
+ * @param curve_size number of steps
+ */
+void output_not_jerky_motion_curve(no_jerky_output_t output_ch, uint32_t *curve, uint32_t curve_size)
+{
+    rmt_symbol_word_t* curve_symbols = NULL;
+    uint32_t curve_symbol_size = 0;
+    uint32_t move_step_offset = 0;
 
-            // encoder_data.symbols = NULL;
-            // encoder_data.rmt_encoder = NULL;
-        }
+    // convert curve data into RMT symbol format
+    if (esp32s3_stepper_curve_to_rmt_symbol(curve, curve_size, 0, &curve_symbols, &curve_symbol_size) != ESP_OK)
+    {
+        printf("motion curve: out of memory, move dropped\n");
+        return;
+    }
+
+    esp32s3_rmt_trans_info_t info = motion_curve_trans_info(output_ch, curve_symbols, curve_symbol_size, curve_size, &move_step_offset);
+    transmit_not_jerky_step_symbols(output_ch, curve_symbols, curve_symbol_size, curve_symbols, &info, current_not_jerky_dir_level(output_ch));
+}
+
+
+/**
+ * @brief Output pre-encoded RMT symbols, e.g. compile time tables from mjt_constexpr.h.
+ *        The symbols are read in place by the copy encoder (no copy, no generation) and must stay valid until the motion is done.
+ *        With a DIR RMT channel, DIR holds its current level for the duration of the symbols.
+ *        NOTE: with CONFIG_NO_JERKY_ISR_IRAM_SAFE, flash-resident symbols are copied to DRAM first.
+ * 
+ * @param output_ch motor output channel
+ * @param symbols RMT symbols, can be flash-resident
+ * @param n_symbols number of symbols
+ */
+void output_not_jerky_symbols(no_jerky_output_t output_ch, const rmt_symbol_word_t *symbols, uint32_t n_symbols)
+{
+    uint32_t move_step_offset = 0;
+    esp32s3_rmt_trans_info_t info = motion_curve_trans_info(output_ch, symbols, n_symbols, 0, &move_step_offset);
+
+    transmit_not_jerky_step_symbols(output_ch, symbols, n_symbols, NULL, &info, current_not_jerky_dir_level(output_ch));
+}
 
-        // free the allocated memory
-        free(encoder_data.symbols);
 
-        // encode and transmit the remainder_chunk
-        if (remainder_chunk > 0)
+/**
+ * @brief Output a motion curve in the given direction.
+ *        With a DIR RMT channel (no_jerky_init_with_dir_channel()), the DIR level is queued as a transaction started
+ *        together with the step transaction, which begins with NO_JERKY_DIR_SETUP_US of idle STEP (not scaled by the
+ *        feed rate). Back-to-back reversing moves then run without any software round-trip. Otherwise, the queue is
+ *        drained before DIR is toggled from software.
+ * 
+ * @param output_ch motor output channel
+ * @param curve [us] time step of each step
+ * @param curve_size number of steps
+ * @param direction >= 0 forward (DIR high), < 0 backward (DIR low)
+ */
+void output_not_jerky_signed_motion_curve(no_jerky_output_t output_ch, uint32_t *curve, uint32_t curve_size, int8_t direction)
+{
+    uint8_t dir_level = (direction >= 0) ? 1 : 0;
+
+    if (output_ch.dir_channel == NULL)
+    {
+        if (gpio_get_level((gpio_num_t) output_ch.dir_pin) != dir_level)
         {
-            // allocate memory for the symbols
-            encoder_data.symbols = (rmt_symbol_word_t*) malloc(remainder_chunk * sizeof(rmt_symbol_word_t));
+            wait_for_motor_motion_done(output_ch);
+            set_not_jerky_dir_level(output_ch, dir_level);
+            esp_rom_delay_us(NO_JERKY_DIR_SETUP_US);
+        }
+        output_ch.tx_queue->direction = (dir_level == 1) ? 1 : -1;
 
-            // set the RMT encoder data
-            encoder_data.n_symbols = remainder_chunk;
-            encoder_data.symbols = &whole_curve_symbols[n_chunks * 48];
+        output_not_jerky_motion_curve(output_ch, curve, curve_size);
+        return;
+    }
 
-            // create new RMT curve encoder
-            ESP_ERROR_CHECK(esp32s3_rmt_new_stepper_curve_encoder(&encoder_data));
+    // step stream: DIR setup gap (symbols[0]) followed by the curve
+    rmt_symbol_word_t* step_symbols = NULL;
+    uint32_t step_symbol_size = 0;
+    if (esp32s3_stepper_curve_to_rmt_symbol(curve, curve_size, 1, &step_symbols, &step_symbol_size) != ESP_OK)
+    {
+        printf("motion curve: out of memory, move dropped\n");
+        return;
+    }
+
+    step_symbols[0].level0 = 0;
+    step_symbols[0].duration0 = NO_JERKY_DIR_SETUP_US - NO_JERKY_DIR_SETUP_US / 2;
+    step_symbols[0].level1 = 0;
+    step_symbols[0].duration1 = NO_JERKY_DIR_SETUP_US / 2;
+
+    output_ch.tx_queue->direction = (dir_level == 1) ? 1 : -1;
+    uint32_t move_step_offset = 0;
+    esp32s3_rmt_trans_info_t step_info = motion_curve_trans_info(output_ch, step_symbols, step_symbol_size, curve_size, &move_step_offset);
+    step_info.n_unscaled = 1;
+
+    transmit_not_jerky_step_symbols(output_ch, step_symbols, step_symbol_size, step_symbols, &step_info, dir_level);
+}
 
-            // transmit RMT curve
-            ESP_ERROR_CHECK(rmt_transmit(output_ch.rmt_channel,
-                                        encoder_data.rmt_encoder,
-                                        curve,                      // dummy data
-                                        curve_size,                 // dummy size
-                                        &rmt_tx_config));
 
-            // delete RMT curve encoder - free the allocated memory!!
-            encoder_data.rmt_encoder->del(encoder_data.rmt_encoder);
+/**
+ * @brief Plan, generate and output a move with its motion profile (move->profile, see motion_profile_t): the shortest
+ *        move from move->bc.x0 to move->bc.xT within move->vmax, amax and jmax, see gen_mjt_with_vmax_constraint().
+ *        The generated dt_array is kept in move, free it once the move is output.
+ * 
+ * @param output_ch motor output channel
+ * @param move move to plan, the profile and its limits
+ * @param direction >= 0 forward (DIR high), < 0 backward (DIR low)
+ */
+void output_not_jerky_move(no_jerky_output_t output_ch, mjt_data_t* move, int8_t direction)
+{
+    gen_mjt_with_vmax_constraint(move);
+
+    output_not_jerky_signed_motion_curve(output_ch, move->dt_array, move->n, direction);
+}
+
+
+/**
+ * @brief Feed rate override: the motor runs its moves (queued or running) at percent of their planned speed, without
+ *        regenerating them. A rest-to-rest move of duration T then takes T * 100 / percent. The change follows a
+ *        minimum jerk ramp of NO_JERKY_FEED_RATE_RAMP_MS, so the override itself is jerk-limited.
+ *        The DIR transactions and the NO_JERKY_DIR_SETUP_US gap before the steps are not scaled.
+ * 
+ * @param output_ch motor output channel
+ * @param percent feed rate [%], 10 to 200
+ */
+void set_not_jerky_feed_rate(no_jerky_output_t output_ch, uint16_t percent)
+{
+    uint32_t feed_rate = ((uint32_t) percent * ESP32S3_RMT_FEED_RATE_ONE) / 100;
+    esp32s3_rmt_set_feed_rate(output_ch.tx_queue, feed_rate, NO_JERKY_FEED_RATE_RAMP_MS * 1000);
+}
+
+
+/**
+ * @brief Position, velocity and phase of a motor, from any task or core (e.g. a 1 kHz control loop).
+ *        The telemetry is updated from the RMT tx done ISR at every transaction (a whole move, or a segment of a
+ *        motion program). Within the transaction being output, the steps
+ *        are counted by walking its symbols up to the nominal time output, published by the feed rate encoder
+ *        (see esp32s3_rmt_nominal_elapsed()), and the velocity is the one of the step being output (its planned time
+ *        step) at the feed rate it is output with. Feed rate changes and ramps never move the position backwards.
+ * 
+ * @param output_ch motor output channel
+ * @return no_jerky_motion_snapshot_t 
+ */
+no_jerky_motion_snapshot_t get_not_jerky_motion_snapshot(no_jerky_output_t output_ch)
+{
+    esp32s3_rmt_telemetry_t telemetry;
+    no_jerky_motion_snapshot_t snapshot;
+    const esp32s3_rmt_trans_info_t* active = &telemetry.active;
+    uint32_t feed_rate = 0;
+    uint32_t elapsed = 0;
+    uint32_t steps = 0;
+    uint32_t step_period = 0;
+
+    do
+    {
+        esp32s3_rmt_read_telemetry(output_ch.tx_queue, &telemetry);
+
+        snapshot = (no_jerky_motion_snapshot_t) {
+            .position = telemetry.position,
+            .velocity = 0.0f,
+            .phase = 1.0f,
+            .symbols_sent = telemetry.symbols_sent,
+            .timestamp = esp_timer_get_time(),
+        };
+
+        if (active->duration == 0 || active->symbols == NULL)
+        {
+            return snapshot;    // idle
         }
 
-        // free the allocated memory
-        free(encoder_data.symbols);
+        // [us] nominal time into the transaction, i.e. at 100% feed rate, from what the encoder has output
+        elapsed = esp32s3_rmt_nominal_elapsed(&telemetry, snapshot.timestamp, &feed_rate);
+
+        // retried if the transaction is done meanwhile
+    } while (!esp32s3_rmt_walk_active_steps(output_ch.tx_queue, &telemetry, elapsed, &steps, &step_period));
+
+    snapshot.position += (active->steps < 0) ? -(int32_t) steps : (int32_t) steps;
+
+    if (step_period > 0)
+    {
+        snapshot.velocity = 1e6f / (float) step_period * ((float) feed_rate / ESP32S3_RMT_FEED_RATE_ONE);
     }
-    else
+
+    if (active->move_steps > 0)
+    {
+        snapshot.phase = (float) (active->move_step_offset + steps) / (float) active->move_steps;
+    }
+
+    return snapshot;
+}
+
+
+/**
+ * @brief Start a motion curve at an absolute esp_timer time, e.g. a time agreed between several controllers.
+ *        The curve is encoded now, after an idle STEP symbol. NO_JERKY_START_LEAD_US before the deadline, a timer
+ *        callback sets that symbol to last until the deadline and queues the move as one transaction: the first step
+ *        edge lands on the deadline within the RMT start latency, not the task scheduling latency. Returns right away.
+ *        The error of the first STEP rising edge is recorded by a GPIO ISR, see get_not_jerky_start_stats(). If the
+ *        channel is busy at the deadline, the move is dropped and counted as failed.
+ *        NOTE: not supported with a DIR RMT channel (its sync manager would hold the move).
+ * 
+ * @param output_ch motor output channel, must be idle
+ * @param curve [us] time step of each step
+ * @param curve_size number of steps
+ * @param start_time [us] esp_timer time (esp_timer_get_time()) of the first step
+ * @return esp_err_t ESP_ERR_INVALID_STATE (channel busy or start already armed), ESP_ERR_INVALID_ARG (deadline closer
+ *                   than NO_JERKY_START_LEAD_US), ESP_ERR_NOT_SUPPORTED (DIR RMT channel), the GPIO ISR error or ESP_OK
+ */
+esp_err_t output_not_jerky_motion_curve_at(no_jerky_output_t output_ch, uint32_t *curve, uint32_t curve_size, int64_t start_time)
+{
+    if (output_ch.dir_channel != NULL)
+    {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    if (output_ch.tx_queue->n_queued != output_ch.tx_queue->n_done || esp_timer_is_active(output_ch.start_timer))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    int64_t fire_in = start_time - NO_JERKY_START_LEAD_US - esp_timer_get_time();
+    if (fire_in < 0)
     {
-        // allocate memory for the symbols
-        encoder_data.symbols = (rmt_symbol_word_t*) malloc(whole_curve_symbol_size * sizeof(rmt_symbol_word_t));
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    no_jerky_scheduled_start_t* start = output_ch.scheduled_start;
+    ESP_RETURN_ON_ERROR(add_no_jerky_first_step_edge_isr(start), "no_jerky", "failed to add the first step edge ISR");
+
+    // pre-encode the move after its idle symbol, nothing but that symbol is left to compute at the deadline
+    uint32_t move_step_offset = 0;
 
-        // set the RMT encoder data
-        encoder_data.n_symbols = whole_curve_symbol_size;
-        encoder_data.symbols = whole_curve_symbols;
+    ESP_RETURN_ON_ERROR(esp32s3_stepper_curve_to_rmt_symbol(curve, curve_size, 1, &start->symbols, &start->n_symbols),
+                        "no_jerky", "failed to encode the motion curve");
+    start->info = motion_curve_trans_info(output_ch, &start->symbols[1], start->n_symbols - 1, curve_size, &move_step_offset);
+    start->info.n_unscaled = 1;     // the idle symbol ends at the deadline whatever the feed rate
+    start->start_time = start_time;
 
-        // create new RMT curve encoder
-        ESP_ERROR_CHECK(esp32s3_rmt_new_stepper_curve_encoder(&encoder_data));
+    esp_err_t err = esp_timer_start_once(output_ch.start_timer, (uint64_t) fire_in);
+    if (err != ESP_OK)
+    {
+        free(start->symbols);
+        start->symbols = NULL;
+    }
 
-        // transmit RMT curve
-        ESP_ERROR_CHECK(rmt_transmit(output_ch.rmt_channel,
-                                    encoder_data.rmt_encoder,
-                                    curve,                      // dummy data
-                                    curve_size,                 // dummy size
-                                    &rmt_tx_config));
+    return err;
+}
 
-        // delete RMT curve encoder - free the allocated memory!!
-        encoder_data.rmt_encoder->del(encoder_data.rmt_encoder);
 
-        // free the allocated memory
-        free(encoder_data.symbols);
+/**
+ * @brief Cancel the deadline start armed by output_not_jerky_motion_curve_at(), before its timer fires.
+ * 
+ * @param output_ch motor output channel
+ * @return esp_err_t ESP_ERR_INVALID_STATE if no start is armed (never armed, or the move is already queued), ESP_OK
+ */
+esp_err_t cancel_not_jerky_motion_curve_at(no_jerky_output_t output_ch)
+{
+    if (esp_timer_stop(output_ch.start_timer) != ESP_OK)
+    {
+        return ESP_ERR_INVALID_STATE;
     }
 
-    // free the allocated memory
-    free(whole_curve_symbols);
+    free(output_ch.scheduled_start->symbols);
+    output_ch.scheduled_start->symbols = NULL;
+
+    return ESP_OK;
+}
+
+
+/**
+ * @brief Start errors of the deadline starts of a motor, see output_not_jerky_motion_curve_at().
+ */
+no_jerky_start_stats_t get_not_jerky_start_stats(no_jerky_output_t output_ch)
+{
+    esp32s3_rmt_telemetry_t telemetry;
+    esp32s3_rmt_read_telemetry(output_ch.tx_queue, &telemetry);
+
+    const esp32s3_rmt_start_stats_t* stats = &telemetry.start_stats;
+    no_jerky_start_stats_t start_stats = {
+        .count = stats->count,
+        .failed = stats->failed,
+        .min_error = stats->min_error,
+        .max_error = stats->max_error,
+        .mean_error = (stats->count > 0) ? (float) stats->sum_error / (float) stats->count : 0.0f,
+    };
+
+    return start_stats;
 }
 
 
 void wait_for_motor_motion_done(no_jerky_output_t output_ch)
 {
     rmt_tx_wait_all_done(output_ch.rmt_channel, -1);
+    esp32s3_rmt_release_done_buffers(output_ch.tx_queue);
+
+    if (output_ch.dir_channel != NULL)
+    {
+        rmt_tx_wait_all_done(output_ch.dir_channel, -1);
+        esp32s3_rmt_release_done_buffers(output_ch.dir_tx_queue);
+
+        // both channels are idle, the next moves start in sync again
+        ESP_ERROR_CHECK(rmt_sync_reset(output_ch.sync_manager));
+    }
 }
 
+/**
+ * @brief Play a precomputed motion program (see no_jerky_program.h) stored in a data partition.
+ *        The partition is memory-mapped and the symbols are fed to the RMT straight from flash, without any heap copy.
+ *        All axes are waited for at every sync marker (end of segment). Blocks until the program is done.
+ *        The STEP channels of the axes share a sync manager while the program plays, so that the axes of each segment
+ *        start together (idle axes queue an idle symbol). NOTE: outputs with a DIR RMT channel already have their own
+ *        sync manager, their axes then start one after the other, skewed by the time to queue a segment of the
+ *        previous axes (tens of us per axis).
+ * 
+ * @param partition_label label of the data partition holding the program
+ * @param outputs motor output channel of each axis of the program
+ * @param n_outputs number of outputs, must match the number of axes of the program
+ * @return esp_err_t ESP_ERR_NOT_FOUND (no partition), ESP_ERR_INVALID_ARG (not a motion program or axes mismatch),
+ *                   ESP_ERR_INVALID_VERSION, ESP_ERR_INVALID_CRC, ESP_ERR_INVALID_SIZE (truncated program or segment
+ *                   table out of range) or ESP_OK
+ */
+esp_err_t play_no_jerky_program(const char* partition_label, const no_jerky_output_t* outputs, uint8_t n_outputs)
+{
+    const esp_partition_t* partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, partition_label);
+    if (partition == NULL)
+    {
+        printf("motion program partition %s not found\n", partition_label);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    const void* mapped_program = NULL;
+    esp_partition_mmap_handle_t mmap_handle;
+    ESP_RETURN_ON_ERROR(esp_partition_mmap(partition, 0, partition->size, ESP_PARTITION_MMAP_DATA, &mapped_program, &mmap_handle),
+                        "no_jerky", "failed to map motion program partition");
+
+    esp_err_t ret = ESP_OK;
+    no_jerky_program_t program;
+    no_jerky_program_err_t program_err = open_no_jerky_program(mapped_program, partition->size, &program);
+
+    if (program_err != NO_JERKY_PROGRAM_OK)
+    {
+        printf("invalid motion program: error %d\n", program_err);
+        ret = no_jerky_program_esp_err(program_err);
+    }
+    else if (program.header->n_axes != n_outputs)
+    {
+        printf("motion program has %d axes, %d outputs given\n", program.header->n_axes, n_outputs);
+        ret = ESP_ERR_INVALID_ARG;
+    }
+    else
+    {
+        for (uint8_t axis = 0; axis < n_outputs; axis++)
+        {
+            wait_for_motor_motion_done(outputs[axis]);
+        }
+
+        rmt_sync_manager_handle_t program_sync = new_no_jerky_program_sync_manager(outputs, n_outputs);
+
+        for (uint32_t segment = 0; segment < program.header->n_segments; segment++)
+        {
+            for (uint8_t axis = 0; axis < n_outputs; axis++)
+            {
+                uint32_t n_symbols = 0;
+                const uint32_t* symbols = get_no_jerky_program_symbols(&program, segment, axis, &n_symbols);
+
+                if (n_symbols > 0)
+                {
+                    output_not_jerky_symbols(outputs[axis], (const rmt_symbol_word_t*) symbols, n_symbols);
+                }
+                else if (program_sync != NULL)
+                {
+                    // the synced axes only start once every one of them has a transaction
+                    output_not_jerky_symbols(outputs[axis], &no_jerky_program_idle_symbol, 1);
+                }
+            }
+
+            // sync marker
+            for (uint8_t axis = 0; axis < n_outputs; axis++)
+            {
+                wait_for_motor_motion_done(outputs[axis]);
+            }
+
+            if (program_sync != NULL)
+            {
+                ESP_ERROR_CHECK(rmt_sync_reset(program_sync));
+            }
+        }
+
+        if (program_sync != NULL)
+        {
+            ESP_ERROR_CHECK(rmt_del_sync_manager(program_sync));
+        }
+    }
+
+    esp_partition_munmap(mmap_handle);
+
+    return ret;
+}
+
+
+/**
+ * @brief esp_err_t of a motion program error.
+ */
+static esp_err_t no_jerky_program_esp_err(no_jerky_program_err_t program_err)
+{
+    switch (program_err)
+    {
+        case NO_JERKY_PROGRAM_OK:
+            return ESP_OK;
+        case NO_JERKY_PROGRAM_ERR_MAGIC:
+            return ESP_ERR_INVALID_ARG;
+        case NO_JERKY_PROGRAM_ERR_VERSION:
+            return ESP_ERR_INVALID_VERSION;
+        case NO_JERKY_PROGRAM_ERR_CRC:
+            return ESP_ERR_INVALID_CRC;
+        case NO_JERKY_PROGRAM_ERR_SIZE:
+        case NO_JERKY_PROGRAM_ERR_SEGMENT:
+        default:
+            return ESP_ERR_INVALID_SIZE;
+    }
+}
+
+
+/**
+ * @brief Sync manager over the STEP channels of the program axes, NULL if there is a single axis or if an output
+ *        already has a sync manager (DIR RMT channel). The channels must be idle.
+ */
+static rmt_sync_manager_handle_t new_no_jerky_program_sync_manager(const no_jerky_output_t* outputs, uint8_t n_outputs)
+{
+    rmt_channel_handle_t channels[SOC_RMT_TX_CANDIDATES_PER_GROUP];
+    rmt_sync_manager_handle_t sync_manager = NULL;
+
+    if (n_outputs < 2 || n_outputs > SOC_RMT_TX_CANDIDATES_PER_GROUP)
+    {
+        return NULL;
+    }
+
+    for (uint8_t axis = 0; axis < n_outputs; axis++)
+    {
+        if (outputs[axis].sync_manager != NULL)
+        {
+            return NULL;
+        }
+        channels[axis] = outputs[axis].rmt_channel;
+    }
+
+    rmt_sync_manager_config_t sync_manager_config = {
+        .tx_channel_array = channels,
+        .array_size = n_outputs,
+    };
+
+    if (rmt_new_sync_manager(&sync_manager_config, &sync_manager) != ESP_OK)
+    {
+        printf("motion program: no sync manager, the axes start one after the other\n");
+        return NULL;
+    }
+
+    return sync_manager;
+}
+
+
+/**
+ * @brief Telemetry of a step transaction: its signed steps and duration, within the move of move_steps steps.
+ *        move_step_offset is advanced by the steps of the transaction.
+ */
+static esp32s3_rmt_trans_info_t motion_curve_trans_info(no_jerky_output_t output_ch, const rmt_symbol_word_t* symbols, uint32_t n_symbols, uint32_t move_steps, uint32_t* move_step_offset)
+{
+    uint32_t n_steps = esp32s3_rmt_count_steps(symbols, n_symbols);
+
+    esp32s3_rmt_trans_info_t info = {
+        .steps = output_ch.tx_queue->direction * (int32_t) n_steps,
+        .duration = esp32s3_rmt_symbol_duration(symbols, n_symbols),
+        .move_steps = (move_steps > 0) ? move_steps : n_steps,
+        .move_step_offset = *move_step_offset,
+        .eot_level = 0,
+    };
+
+    *move_step_offset += n_steps;
+    return info;
+}
+
+
+/**
+ * @brief Start timer callback of output_not_jerky_motion_curve_at(): idle STEP until the deadline, then the move, in
+ *        one transaction. Never blocks: if the channel is busy or the transmit fails, the move is dropped and counted.
+ */
+static void no_jerky_scheduled_start_callback(void* arg)
+{
+    no_jerky_scheduled_start_t* start = (no_jerky_scheduled_start_t*) arg;
+
+    if (start->tx_queue->n_queued != start->tx_queue->n_done)
+    {
+        // queued meanwhile: the move would wait for it (and the transmit for a free slot)
+        free(start->symbols);
+        start->symbols = NULL;
+        esp32s3_rmt_record_start_failure(start->tx_queue);
+        return;
+    }
+
+    // the timer fired NO_JERKY_START_LEAD_US early, give or take the dispatch latency
+    int64_t pad = start->start_time - esp_timer_get_time() - NO_JERKY_START_LATENCY_US;
+    pad = (pad < 2) ? 2 : pad;
+    pad = (pad > 2 * 0x7FFF) ? 2 * 0x7FFF : pad;
+
+    start->symbols[0].level0 = 0;
+    start->symbols[0].duration0 = pad - pad / 2;
+    start->symbols[0].level1 = 0;
+    start->symbols[0].duration1 = pad / 2;
+    start->info.duration += pad;
+
+    // the start error is measured at the first step edge
+    gpio_intr_enable((gpio_num_t) start->step_pin);
+
+    esp_err_t err = esp32s3_rmt_transmit(start->rmt_channel,
+                                         start->tx_queue,
+                                         start->tx_queue->feed_rate_encoder,
+                                         start->symbols,
+                                         start->n_symbols * sizeof(rmt_symbol_word_t),
+                                         start->symbols,
+                                         &start->info);
+    start->symbols = NULL;  // owned by the transaction, or freed by the failed transmit
+
+    if (err != ESP_OK)
+    {
+        gpio_intr_disable((gpio_num_t) start->step_pin);
+        esp32s3_rmt_record_start_failure(start->tx_queue);
+    }
+}
+
+
+/**
+ * @brief STEP rising edge ISR, armed by no_jerky_scheduled_start_callback(): records the error of the first step edge
+ *        and disarms itself.
+ */
+static void ESP32S3_RMT_ISR_ATTR no_jerky_first_step_edge_isr(void* arg)
+{
+    no_jerky_scheduled_start_t* start = (no_jerky_scheduled_start_t*) arg;
+    int64_t now = esp_timer_get_time();
+
+    gpio_ll_intr_disable(GPIO_LL_GET_HW(GPIO_PORT_0), start->step_pin);
+    esp32s3_rmt_record_start_error(start->tx_queue, (int32_t) (now - start->start_time));
+}
+
+
+/**
+ * @brief Read back STEP (the RMT output stays routed to the pin) with a disarmed rising edge interrupt, once per output.
+ *        The GPIO ISR service may already be installed by the application.
+ */
+static esp_err_t add_no_jerky_first_step_edge_isr(no_jerky_scheduled_start_t* start)
+{
+    if (start->edge_isr_added)
+    {
+        return ESP_OK;
+    }
+
+#if CONFIG_NO_JERKY_ISR_IRAM_SAFE
+    esp_err_t err = gpio_install_isr_service(ESP_INTR_FLAG_IRAM);
+#else
+    esp_err_t err = gpio_install_isr_service(0);
+#endif
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE)
+    {
+        return err;
+    }
+
+    gpio_num_t step_pin = (gpio_num_t) start->step_pin;
+    ESP_RETURN_ON_ERROR(gpio_input_enable(step_pin), "no_jerky", "failed to read back STEP");
+    ESP_RETURN_ON_ERROR(gpio_set_intr_type(step_pin, GPIO_INTR_POSEDGE), "no_jerky", "failed to set the STEP edge interrupt");
+    ESP_RETURN_ON_ERROR(gpio_intr_disable(step_pin), "no_jerky", "failed to set the STEP edge interrupt");
+    ESP_RETURN_ON_ERROR(gpio_isr_handler_add(step_pin, no_jerky_first_step_edge_isr, start), "no_jerky", "failed to add the STEP edge ISR");
+
+    start->edge_isr_added = true;
+    return ESP_OK;
+}
+
+
+/**
+ * @brief Queue a step transaction. With a DIR RMT channel, the sync manager only starts the step transaction together
+ *        with a DIR transaction: DIR is queued first, at dir_level for NO_JERKY_DIR_SETUP_US and held at dir_level
+ *        once done. It is not scaled by the feed rate, so it ends before any step transaction with a setup gap and the
+ *        next pair starts when the step transaction is done (a shorter step transaction delays it by the difference).
+ * 
+ * @param output_ch motor output channel
+ * @param symbols step symbols
+ * @param n_symbols number of symbols
+ * @param owned_buffer buffer freed once the transaction is done (usually symbols), NULL if none
+ * @param info telemetry of the step transaction, see motion_curve_trans_info()
+ * @param dir_level DIR level during the transaction (DIR RMT channel only)
+ */
+static void transmit_not_jerky_step_symbols(no_jerky_output_t output_ch, const rmt_symbol_word_t* symbols, uint32_t n_symbols, rmt_symbol_word_t* owned_buffer, const esp32s3_rmt_trans_info_t* info, uint8_t dir_level)
+{
+    if (output_ch.dir_channel != NULL)
+    {
+        // DIR stream: the new level during the setup gap of the step transaction
+        rmt_symbol_word_t* dir_symbols = NULL;
+        uint32_t dir_symbol_size = 0;
+        esp32s3_level_to_rmt_symbol(dir_level, NO_JERKY_DIR_SETUP_US, &dir_symbols, &dir_symbol_size);
+
+        // DIR holds its level once done, until the next DIR transaction
+        esp32s3_rmt_trans_info_t dir_info = {
+            .eot_level = dir_level,
+        };
+
+        ESP_ERROR_CHECK(esp32s3_rmt_transmit(output_ch.dir_channel,
+                                            output_ch.dir_tx_queue,
+                                            NULL,
+                                            dir_symbols,
+                                            dir_symbol_size * sizeof(rmt_symbol_word_t),
+                                            dir_symbols,
+                                            &dir_info));
+    }
+
+    ESP_ERROR_CHECK(esp32s3_rmt_transmit(output_ch.rmt_channel,
+                                        output_ch.tx_queue,
+                                        output_ch.tx_queue->feed_rate_encoder,
+                                        symbols,
+                                        n_symbols * sizeof(rmt_symbol_word_t),
+                                        owned_buffer,
+                                        info));
+}
+
+
+/**
+ * @brief DIR level of the moves queued last: moves without a direction keep it.
+ */
+static uint8_t current_not_jerky_dir_level(no_jerky_output_t output_ch)
+{
+    return (output_ch.tx_queue->direction > 0) ? 1 : 0;
+}
+
+
+/**
+ * @brief Set the DIR GPIO of a motor and of its followers (DIR without RMT channel).
+ */
+static void set_not_jerky_dir_level(no_jerky_output_t output_ch, uint8_t level)
+{
+    gpio_set_level((gpio_num_t) output_ch.dir_pin, level);
+
+    for (uint8_t i = 0; i < output_ch.followers->n; i++)
+    {
+        gpio_set_level((gpio_num_t) output_ch.followers->dir_pins[i], level ^ output_ch.followers->dir_inverted[i]);
+    }
+}
+
+
 // TODO
 // void resync_no_jerky_group_output(no_jerky_output_t output_ch)
 // {
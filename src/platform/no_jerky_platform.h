@@ -11,7 +11,34 @@ extern "C" {
 
 #include <stdint.h>
 #include "esp32s3_rmt.h"
+#include "esp32s3_lcd_parallel.h"
+#include "no_jerky_program.h"
 #include <esp_async_memcpy.h>
+#include <esp_timer.h>
+
+
+typedef struct mjt_data mjt_data_t;     // planned move of output_not_jerky_move(), see mjt.h
+
+
+#ifndef NO_JERKY_DIR_SETUP_US
+#define NO_JERKY_DIR_SETUP_US 5    // [us] DIR setup time before the first step edge, check the stepper driver datasheet (>= 2)
+#endif
+
+#ifndef NO_JERKY_MAX_FOLLOWERS
+#define NO_JERKY_MAX_FOLLOWERS 3        // motors running the moves of one output channel, see attach_not_jerky_follower()
+#endif
+
+#ifndef NO_JERKY_START_LEAD_US
+#define NO_JERKY_START_LEAD_US 500      // [us] a deadline start is queued this long before the deadline, see output_not_jerky_motion_curve_at()
+#endif
+
+#ifndef NO_JERKY_START_LATENCY_US
+#define NO_JERKY_START_LATENCY_US 0     // [us] transmit to first edge latency, calibrate with the mean error of get_not_jerky_start_stats()
+#endif
+
+#ifndef NO_JERKY_FEED_RATE_RAMP_MS
+#define NO_JERKY_FEED_RATE_RAMP_MS 200  // [ms] minimum jerk ramp of a feed rate override change, see set_not_jerky_feed_rate()
+#endif
 
 
 typedef struct no_jerky_motor_pins
@@ -22,22 +49,114 @@ typedef struct no_jerky_motor_pins
 } no_jerky_motor_pins_t;
 
 
+typedef struct no_jerky_scheduled_start
+{
+    // pre-armed move of output_not_jerky_motion_curve_at(), queued by the start timer
+    rmt_channel_handle_t rmt_channel;
+    esp32s3_rmt_tx_queue_t* tx_queue;
+    uint8_t step_pin;                   // read back by the first step edge ISR, for the start error
+    bool edge_isr_added;
+    int64_t start_time;                 // [us] esp_timer time of the first step
+    rmt_symbol_word_t* symbols;         // pre-encoded move after an idle STEP symbol (set at the deadline), owned by its transaction once queued
+    uint32_t n_symbols;                 // including the idle symbol
+    esp32s3_rmt_trans_info_t info;
+} no_jerky_scheduled_start_t;
+
+
+typedef struct no_jerky_followers
+{
+    // motors running the same moves, STEP (and DIR if dir_channel) routed from the leader output through the GPIO matrix
+    uint8_t n;
+    uint8_t dir_pins[NO_JERKY_MAX_FOLLOWERS];
+    uint8_t dir_inverted[NO_JERKY_MAX_FOLLOWERS];
+} no_jerky_followers_t;
+
+
 typedef struct no_jerky_output
 {
     // platform specific PWM/motor output peripheral
+    uint8_t step_pin;
     rmt_channel_handle_t rmt_channel;
+    esp32s3_rmt_tx_queue_t* tx_queue;   // transactions queued on rmt_channel
+
+    // DIR output - a second RMT channel synchronised with rmt_channel, if created with no_jerky_init_with_dir_channel()
+    uint8_t dir_pin;
+    rmt_channel_handle_t dir_channel;       // NULL if DIR is a plain GPIO
+    esp32s3_rmt_tx_queue_t* dir_tx_queue;
+    rmt_sync_manager_handle_t sync_manager;
+
+    // shared by every copy of the output, see attach_not_jerky_follower()
+    no_jerky_followers_t* followers;
+
+    // deadline start, see output_not_jerky_motion_curve_at()
+    esp_timer_handle_t start_timer;
+    no_jerky_scheduled_start_t* scheduled_start;
 } no_jerky_output_t;
 
 
+typedef struct no_jerky_motion_snapshot
+{
+    int32_t position;       // [steps] signed by the DIR level, steps output so far within the transaction being output
+    float velocity;         // [steps/s] velocity of the step being output (unsigned), 0 if idle
+    float phase;            // [0, 1] progress of the current move, 1 if idle
+    uint32_t symbols_sent;  // RMT symbols of the done transactions
+    int64_t timestamp;      // [us] esp_timer time of the snapshot
+} no_jerky_motion_snapshot_t;
+
+
+typedef struct no_jerky_start_stats
+{
+    uint32_t count;         // number of deadline starts
+    uint32_t failed;        // deadline starts not queued (channel busy or RMT error), their move is dropped
+    int32_t min_error;      // [us] first step - deadline
+    int32_t max_error;      // [us]
+    float mean_error;       // [us]
+} no_jerky_start_stats_t;
+
+
+typedef struct no_jerky_parallel_output
+{
+    // platform specific parallel bus output, one STEP bit per axis - more axes than RMT channels
+    esp32s3_lcd_parallel_t* lcd;
+    uint8_t n_axes;
+} no_jerky_parallel_output_t;
+
+
 no_jerky_output_t no_jerky_init(no_jerky_motor_pins_t motor_pins);
+no_jerky_output_t no_jerky_init_with_dir_channel(no_jerky_motor_pins_t motor_pins);
+esp_err_t attach_not_jerky_follower(no_jerky_output_t* output_ch, no_jerky_motor_pins_t follower_pins, uint8_t invert_dir);
 void output_not_jerky_motion_curve(no_jerky_output_t output_ch, uint32_t *curve, uint32_t curve_size);
+void output_not_jerky_signed_motion_curve(no_jerky_output_t output_ch, uint32_t *curve, uint32_t curve_size, int8_t direction);
+esp_err_t output_not_jerky_motion_curve_at(no_jerky_output_t output_ch, uint32_t *curve, uint32_t curve_size, int64_t start_time);
+esp_err_t cancel_not_jerky_motion_curve_at(no_jerky_output_t output_ch);
+void output_not_jerky_move(no_jerky_output_t output_ch, mjt_data_t* move, int8_t direction);
+no_jerky_start_stats_t get_not_jerky_start_stats(no_jerky_output_t output_ch);
+void output_not_jerky_symbols(no_jerky_output_t output_ch, const rmt_symbol_word_t *symbols, uint32_t n_symbols);
 void wait_for_motor_motion_done(no_jerky_output_t output_ch);
+no_jerky_motion_snapshot_t get_not_jerky_motion_snapshot(no_jerky_output_t output_ch);
+void set_not_jerky_feed_rate(no_jerky_output_t output_ch, uint16_t percent);
+no_jerky_parallel_output_t no_jerky_parallel_init(const no_jerky_motor_pins_t* motor_pins, uint8_t n_axes, const uint8_t* spare_data_pins, uint8_t pclk_pin, uint8_t dc_pin);
+void output_not_jerky_parallel_motion_curves(no_jerky_parallel_output_t output, uint32_t* const* curves, const uint32_t* curve_sizes);
+esp_err_t play_no_jerky_program(const char* partition_label, const no_jerky_output_t* outputs, uint8_t n_outputs);
 
 void no_jerky_delay_ms(uint16_t ms);
 
-
 #ifdef __cplusplus
 }
+
+extern "C++" {   // this header can be included from other extern "C" blocks
+#include <array>
+
+/**
+ * @brief Play a compile time symbol table generated by no_jerky::mjt_rmt_symbols(), see mjt_constexpr.h
+ */
+template <std::size_t N>
+inline void output_not_jerky_symbols(no_jerky_output_t output_ch, const std::array<uint32_t, N>& symbols)
+{
+    static_assert(sizeof(rmt_symbol_word_t) == sizeof(uint32_t), "raw symbol values must match rmt_symbol_word_t");
+    output_not_jerky_symbols(output_ch, reinterpret_cast<const rmt_symbol_word_t*>(symbols.data()), N);
+}
+}
 #endif
 
 #endif  // NO_JERKY_PLATFORM_H 
\ No newline at end of file
@@ -0,0 +1,271 @@
+#include <stddef.h>
+
+#include "parallel_step_merge.h"
+
+
+// static functions
+static void apply_parallel_step_edges(parallel_step_merger_t* merger);
+static void schedule_parallel_step_edge(parallel_step_merger_t* merger, parallel_step_axis_t* axis);
+static uint64_t parallel_step_period_samples(uint32_t dt, uint8_t samples_per_us);
+static uint64_t parallel_step_high_samples(uint32_t dt, uint8_t samples_per_us);
+static void sift_down_parallel_step_heap(parallel_step_merger_t* merger, uint8_t i);
+
+
+/**
+ * @brief Set up the merge of the step schedules of several axes.
+ *        Each step starts with a rising edge and is high for half of its time step, same as the RMT output.
+ *        A step lasts 2 samples at least (one high, one low): shorter time steps, e.g. 0 us, are stretched to it.
+ *
+ * @param merger merger state
+ * @param dt_arrays [us] time steps of each axis, must stay valid while merging
+ * @param n_steps number of steps of each axis
+ * @param n_axes number of axes, PARALLEL_STEP_MAX_AXES at most
+ * @param samples_per_us bus clock [MHz], i.e. samples per us
+ */
+void init_parallel_step_merger(parallel_step_merger_t* merger, uint32_t* const* dt_arrays, const uint32_t* n_steps, uint8_t n_axes, uint8_t samples_per_us)
+{
+    if (n_axes > PARALLEL_STEP_MAX_AXES)
+    {
+        n_axes = PARALLEL_STEP_MAX_AXES;
+    }
+
+    merger->n_axes = n_axes;
+    merger->samples_per_us = samples_per_us;
+    merger->levels = 0;
+    merger->t = 0;
+    merger->done = 0;
+    merger->gap_samples = 0;
+
+    for (uint8_t i = 0; i < n_axes; i++)
+    {
+        parallel_step_axis_t* axis = &merger->axes[i];
+        axis->dt_array = dt_arrays[i];
+        axis->n = n_steps[i];
+        axis->idx = 0;
+        axis->step_start = 0;
+        axis->level = 0;
+        axis->next_edge = (axis->n > 0) ? 0 : UINT64_MAX;
+
+        merger->heap[i] = i;
+    }
+
+    // heapify
+    merger->heap_size = n_axes;
+    for (int16_t i = n_axes / 2 - 1; i >= 0; i--)
+    {
+        sift_down_parallel_step_heap(merger, i);
+    }
+}
+
+
+/**
+ * @brief Generate the next samples of the bit-stream, bit i of each sample is the STEP level of axis i.
+ *        Every call but the first starts after merger->gap_samples of bus idle time (levels held): edges that fall
+ *        in it are output on the first sample after it, one sample apart per axis, and later edges keep their schedule.
+ *
+ * @param merger merger state
+ * @param samples output buffer
+ * @param n_samples size of the buffer
+ * @return uint32_t number of samples generated, less than n_samples once every axis is done (0 afterwards)
+ */
+uint32_t fill_parallel_step_samples(parallel_step_merger_t* merger, uint16_t* samples, uint32_t n_samples)
+{
+    uint32_t i = 0;
+
+    if (merger->t > 0 && !merger->done)
+    {
+        merger->t += merger->gap_samples;
+    }
+
+    while (i < n_samples && !merger->done)
+    {
+        // edges are applied right before their sample is generated, never at the end of a buffer (before a gap)
+        apply_parallel_step_edges(merger);
+
+        uint64_t next_edge = (merger->heap_size > 0) ? merger->axes[merger->heap[0]].next_edge : UINT64_MAX;
+        if (next_edge == UINT64_MAX)
+        {
+            // all axes done, end the stream with one sample of the idle (low) levels
+            samples[i++] = merger->levels;
+            merger->done = 1;
+            break;
+        }
+
+        // levels are constant until the next edge
+        uint64_t run = next_edge - merger->t;
+        if (run > n_samples - i)
+        {
+            run = n_samples - i;
+        }
+
+        for (uint32_t k = 0; k < run; k++)
+        {
+            samples[i++] = merger->levels;
+        }
+        merger->t += run;
+    }
+
+    return i;
+}
+
+
+/**
+ * @brief Check a bit-stream against the per-axis step timelines (host verification).
+ *
+ * @param samples whole bit-stream
+ * @param n_samples number of samples
+ * @param samples_per_us bus clock [MHz]
+ * @param dt_arrays [us] time steps of each axis
+ * @param n_steps number of steps of each axis
+ * @param n_axes number of axes
+ * @return int32_t largest edge timing error [samples], -1 if an axis has missing or extra edges
+ */
+int32_t check_parallel_step_samples(const uint16_t* samples, uint32_t n_samples, uint8_t samples_per_us, uint32_t* const* dt_arrays, const uint32_t* n_steps, uint8_t n_axes)
+{
+    int32_t max_error = 0;
+
+    for (uint8_t a = 0; a < n_axes; a++)
+    {
+        uint32_t n_edges = 0;
+        uint64_t step_start = 0;
+        uint8_t level = 0;
+
+        for (uint32_t i = 0; i < n_samples; i++)
+        {
+            uint8_t bit = (samples[i] >> a) & 1;
+            if (bit == level)
+            {
+                continue;
+            }
+
+            uint32_t step = n_edges / 2;
+            if (step >= n_steps[a])
+            {
+                return -1;
+            }
+
+            uint64_t expected = step_start;
+            if (bit == 0)
+            {
+                expected += parallel_step_high_samples(dt_arrays[a][step], samples_per_us);
+                step_start += parallel_step_period_samples(dt_arrays[a][step], samples_per_us);
+            }
+
+            int64_t error = (int64_t) i - (int64_t) expected;
+            error = (error < 0) ? -error : error;
+            if (error > max_error)
+            {
+                max_error = (int32_t) error;
+            }
+
+            level = bit;
+            n_edges++;
+        }
+
+        if (n_edges != 2 * n_steps[a])
+        {
+            return -1;
+        }
+    }
+
+    return max_error;
+}
+
+
+/**
+ * @brief Apply every edge due at the current sample. Edges already late (skipped bus gap) are applied too and the
+ *        next edge of their axis is pushed to the next sample at least, so that no pulse collapses.
+ */
+static void apply_parallel_step_edges(parallel_step_merger_t* merger)
+{
+    while (merger->heap_size > 0 && merger->axes[merger->heap[0]].next_edge <= merger->t)
+    {
+        uint8_t axis_idx = merger->heap[0];
+        parallel_step_axis_t* axis = &merger->axes[axis_idx];
+
+        axis->level ^= 1;
+        merger->levels ^= (uint16_t) (1 << axis_idx);
+
+        schedule_parallel_step_edge(merger, axis);
+        if (axis->next_edge <= merger->t)
+        {
+            axis->next_edge = merger->t + 1;
+        }
+        sift_down_parallel_step_heap(merger, 0);
+    }
+}
+
+
+/**
+ * @brief Compute the next edge of an axis once its current edge has been applied.
+ */
+static void schedule_parallel_step_edge(parallel_step_merger_t* merger, parallel_step_axis_t* axis)
+{
+    uint32_t dt = axis->dt_array[axis->idx];
+
+    if (axis->level == 1)
+    {
+        // falling edge after half of the time step
+        axis->next_edge = axis->step_start + parallel_step_high_samples(dt, merger->samples_per_us);
+    }
+    else
+    {
+        // rising edge of the next step, always after the falling edge
+        axis->step_start += parallel_step_period_samples(dt, merger->samples_per_us);
+        axis->idx++;
+        axis->next_edge = (axis->idx < axis->n) ? axis->step_start : UINT64_MAX;
+    }
+}
+
+
+/**
+ * @brief Samples of a step of dt us: 2 at least, so that the next rising edge comes after the falling edge.
+ */
+static uint64_t parallel_step_period_samples(uint32_t dt, uint8_t samples_per_us)
+{
+    uint64_t period = (uint64_t) dt * samples_per_us;
+
+    return (period > 2) ? period : 2;
+}
+
+
+/**
+ * @brief Samples of the high part of a step of dt us: half of the time step, at least one sample wide.
+ *        Always shorter than parallel_step_period_samples().
+ */
+static uint64_t parallel_step_high_samples(uint32_t dt, uint8_t samples_per_us)
+{
+    uint64_t high = (uint64_t) (dt >> 1) * samples_per_us;
+
+    return (high > 0) ? high : 1;
+}
+
+
+static void sift_down_parallel_step_heap(parallel_step_merger_t* merger, uint8_t i)
+{
+    while (1)
+    {
+        uint8_t smallest = i;
+        uint8_t left = 2 * i + 1;
+        uint8_t right = 2 * i + 2;
+
+        if (left < merger->heap_size && merger->axes[merger->heap[left]].next_edge < merger->axes[merger->heap[smallest]].next_edge)
+        {
+            smallest = left;
+        }
+        if (right < merger->heap_size && merger->axes[merger->heap[right]].next_edge < merger->axes[merger->heap[smallest]].next_edge)
+        {
+            smallest = right;
+        }
+
+        if (smallest == i)
+        {
+            return;
+        }
+
+        uint8_t tmp = merger->heap[i];
+        merger->heap[i] = merger->heap[smallest];
+        merger->heap[smallest] = tmp;
+        i = smallest;
+    }
+}
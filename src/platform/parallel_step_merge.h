@@ -0,0 +1,56 @@
+/**
+ * @file parallel_step_merge.h
+ * @brief Merge the step schedules of several axes into one time-sliced parallel bit-stream (one bit per axis per sample).
+ *        Platform independent: the bit-stream is clocked out by a parallel bus peripheral (see esp32s3_lcd_parallel.h)
+ *        and can be generated and checked on a host.
+ */
+#ifndef PARALLEL_STEP_MERGE_H
+#define PARALLEL_STEP_MERGE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+
+#define PARALLEL_STEP_MAX_AXES 16
+
+
+typedef struct parallel_step_axis
+{
+    const uint32_t* dt_array;   // [us] time step of each step, 0 allowed (stretched to 2 samples)
+    uint32_t n;                 // number of steps
+    uint32_t idx;               // current step
+    uint64_t step_start;        // [sample] start of the current step
+    uint64_t next_edge;         // [sample] time of the next edge, UINT64_MAX when done
+    uint8_t level;              // current STEP level
+} parallel_step_axis_t;
+
+
+typedef struct parallel_step_merger
+{
+    parallel_step_axis_t axes[PARALLEL_STEP_MAX_AXES];
+    uint8_t n_axes;
+    uint8_t samples_per_us;     // bus clock [MHz]
+
+    // k-way merge: min-heap of axis indices keyed by their next edge
+    uint8_t heap[PARALLEL_STEP_MAX_AXES];
+    uint8_t heap_size;
+
+    uint16_t levels;            // current output word, bit i = STEP of axis i
+    uint64_t t;                 // [sample] time of the next sample to generate
+    uint8_t done;               // every axis is done and the stream has returned to idle
+    uint32_t gap_samples;       // [sample] idle time the bus inserts between two buffers, skipped at the start of every fill but the first
+} parallel_step_merger_t;
+
+
+void init_parallel_step_merger(parallel_step_merger_t* merger, uint32_t* const* dt_arrays, const uint32_t* n_steps, uint8_t n_axes, uint8_t samples_per_us);
+uint32_t fill_parallel_step_samples(parallel_step_merger_t* merger, uint16_t* samples, uint32_t n_samples);
+int32_t check_parallel_step_samples(const uint16_t* samples, uint32_t n_samples, uint8_t samples_per_us, uint32_t* const* dt_arrays, const uint32_t* n_steps, uint8_t n_axes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // PARALLEL_STEP_MERGE_H
@@ -0,0 +1,160 @@
+/**
+ * @file mjt_engine_benchmark.c
+ * @brief Host benchmark of the MJT step generator engines (see mjt_engine_t): generation time and step edge error
+ *        against the analytic crossing time of each step.
+ *
+ *        Build and run from the repository root:
+ *            python python/gen_timestep_lut.py --min-interval-us 20 --max-interval-us 5000 --resolution-us 2 --branching 10 --output /tmp/mjt_mutli_level_timestep_lut.h
+ *            gcc -O2 -Isrc/motion -I/tmp test/host/mjt_engine_benchmark.c src/motion/mjt.c src/motion/s_curve.c -lm -o /tmp/mjt_engine_benchmark
+ *            /tmp/mjt_engine_benchmark
+ *
+ *        NOTE: host timings only rank the engines, absolute numbers on the ESP32-S3 are ~20x slower (no double FPU).
+ *        The lut vector search evaluates its candidates in float, which the ESP32-S3 runs on its FPU: its target
+ *        speedup over the lut search is larger than the host one.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include "mjt.h"
+
+
+#define BENCHMARK_REPEATS 10
+
+
+typedef struct engine_benchmark
+{
+    uint32_t n;             // number of steps
+    double gen_time;        // [s] mean generation time
+    double max_edge_error;  // [s] largest step edge error
+    double rms_edge_error;  // [s]
+    double duration;        // [s] sum of the time steps
+    uint32_t n_dt_mismatch; // time steps that differ from the lut search ones
+} engine_benchmark_t;
+
+
+static double benchmark_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+
+/**
+ * @brief Time at which the planned quintic reaches x, by bisection (the reference for the edge error).
+ */
+static double mjt_time_at_position(const mjt_data_t* data, double x)
+{
+    double low = 0;
+    double high = data->bc.T;
+
+    for (uint8_t i = 0; i < 64; i++)
+    {
+        double mid = 0.5 * (low + high);
+
+        if (data->profile->position(data, mid) < x)
+        {
+            low = mid;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+
+    return high;
+}
+
+
+static engine_benchmark_t run_engine_benchmark(mjt_engine_t engine, uint32_t xT, double T, double dda_tick)
+{
+    engine_benchmark_t result = {0};
+    mjt_data_t data = init_mjt_data();
+
+    data.bc.xT = xT;
+    data.bc.T = T;
+    data.dx = 1;
+    data.engine = engine;
+    data.dda_tick = dda_tick;
+
+    double t0 = benchmark_now();
+    for (uint8_t i = 0; i < BENCHMARK_REPEATS; i++)
+    {
+        free(data.dt_array);
+        gen_mjt_with_time_constraint(&data);
+    }
+    result.gen_time = (benchmark_now() - t0) / BENCHMARK_REPEATS;
+    result.n = data.n;
+
+    // the last step sits on the flat end of the move where the reference is ill-conditioned, it is left out
+    double t = 0;
+    double sum_squared_error = 0;
+    for (uint32_t k = 0; k < data.n; k++)
+    {
+        t += data.dt_array[k] * 1e-6;
+
+        if (k + 1 < data.n)
+        {
+            double error = fabs(t - mjt_time_at_position(&data, (k + 1) * data.dx));
+            result.max_edge_error = (error > result.max_edge_error) ? error : result.max_edge_error;
+            sum_squared_error += error * error;
+        }
+    }
+    result.duration = t;
+    result.rms_edge_error = (data.n > 1) ? sqrt(sum_squared_error / (data.n - 1)) : 0;
+
+    mjt_data_t reference = init_mjt_data();
+    reference.bc = data.bc;
+    reference.dx = data.dx;
+    gen_mjt_with_time_constraint(&reference);
+    for (uint32_t k = 0; k < data.n || k < reference.n; k++)
+    {
+        result.n_dt_mismatch += (k >= data.n || k >= reference.n || data.dt_array[k] != reference.dt_array[k]);
+    }
+
+    free(reference.dt_array);
+    free(data.dt_array);
+
+    return result;
+}
+
+
+static void print_engine_benchmark(const char* name, uint32_t xT, engine_benchmark_t result)
+{
+    if (result.n == 0)
+    {
+        printf("%-20s xT=%-6u generation failed\n", name, xT);
+        return;
+    }
+
+    printf("%-20s xT=%-6u n=%-6u gen=%8.3f ms (%6.1f ns/step)  edge error max=%5.2f us rms=%5.2f us  duration=%.6f s  dt != lut search: %u\n",
+           name, xT, result.n, result.gen_time * 1e3, result.gen_time * 1e9 / result.n,
+           result.max_edge_error * 1e6, result.rms_edge_error * 1e6, result.duration, result.n_dt_mismatch);
+}
+
+
+int main(void)
+{
+    const uint32_t distances[] = {200, 2000, 20000};
+    const double T = 1;             // [s] move duration
+    const double dda_tick = 10e-6;  // [s]
+
+    for (uint8_t i = 0; i < sizeof(distances) / sizeof(distances[0]); i++)
+    {
+        print_engine_benchmark("lut search", distances[i],
+                               run_engine_benchmark(MJT_ENGINE_LUT_SEARCH, distances[i], T, dda_tick));
+        print_engine_benchmark("lut vector search", distances[i],
+                               run_engine_benchmark(MJT_ENGINE_LUT_VECTOR_SEARCH, distances[i], T, dda_tick));
+        print_engine_benchmark("forward difference", distances[i],
+                               run_engine_benchmark(MJT_ENGINE_FORWARD_DIFFERENCE, distances[i], T, dda_tick));
+    }
+
+    // the tick must stay shorter than the shortest step interval (~53 us for 20000 steps in 1 s)
+    print_engine_benchmark("forward difference, 100 us tick", distances[2],
+                           run_engine_benchmark(MJT_ENGINE_FORWARD_DIFFERENCE, distances[2], T, 100e-6));
+
+    return 0;
+}
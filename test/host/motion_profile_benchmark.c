@@ -0,0 +1,173 @@
+/**
+ * @file motion_profile_benchmark.c
+ * @brief Host benchmark of the motion profiles (see motion_profile_t) for the same limits: move duration, generation
+ *        time, step edge error against a bisection on the profile position, and the peak velocity, acceleration and
+ *        jerk of the planned profile (central differences).
+ *
+ *        Build and run from the repository root (limits optional, default 5000 5e4 2e6):
+ *            python python/gen_timestep_lut.py --min-interval-us 20 --max-interval-us 5000 --resolution-us 2 --branching 10 --output /tmp/mjt_mutli_level_timestep_lut.h
+ *            gcc -O2 -Isrc/motion -I/tmp test/host/motion_profile_benchmark.c src/motion/mjt.c src/motion/s_curve.c -lm -o /tmp/motion_profile_benchmark
+ *            /tmp/motion_profile_benchmark [vmax amax jmax]
+ *
+ *        NOTE: host timings only rank the profiles, the ESP32-S3 has no double FPU (cbrt and acos of the S-curve jerk
+ *        segments cost relatively more there).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include "mjt.h"
+
+
+#define BENCHMARK_REPEATS 20
+#define BENCHMARK_PEAK_SAMPLES 20000
+
+
+typedef struct profile_benchmark
+{
+    double T;               // [s] planned move duration
+    uint32_t n;             // number of steps
+    double gen_time;        // [s] mean plan and generation time
+    double max_edge_error;  // [s] largest step edge error
+    double v_peak;          // [steps/s] peaks of the planned profile
+    double a_peak;          // [steps/s^2]
+    double j_peak;          // [steps/s^3]
+} profile_benchmark_t;
+
+
+static double benchmark_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+
+/**
+ * @brief Time at which the planned profile reaches x, by bisection (the reference for the edge error).
+ */
+static double profile_time_at_position(const mjt_data_t* data, double x)
+{
+    double low = 0;
+    double high = data->bc.T;
+
+    for (uint8_t i = 0; i < 64; i++)
+    {
+        double mid = 0.5 * (low + high);
+
+        if (data->profile->position(data, mid) < x)
+        {
+            low = mid;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+
+    return high;
+}
+
+
+static profile_benchmark_t run_profile_benchmark(const motion_profile_t* profile, mjt_engine_t engine, uint32_t xT, uint32_t vmax, double amax, double jmax)
+{
+    profile_benchmark_t result = {0};
+    mjt_data_t data = init_mjt_data();
+
+    data.bc.xT = xT;
+    data.dx = 1;
+    data.profile = profile;
+    data.engine = engine;
+    data.vmax = vmax;
+    data.amax = amax;
+    data.jmax = jmax;
+
+    double t0 = benchmark_now();
+    for (uint8_t i = 0; i < BENCHMARK_REPEATS; i++)
+    {
+        free(data.dt_array);
+        gen_mjt_with_vmax_constraint(&data);
+    }
+    result.gen_time = (benchmark_now() - t0) / BENCHMARK_REPEATS;
+    result.n = data.n;
+    result.T = data.bc.T;
+
+    // the last step sits on the flat end of the move where the reference is ill-conditioned, it is left out
+    double t = 0;
+    for (uint32_t k = 0; k + 1 < data.n; k++)
+    {
+        t += data.dt_array[k] * 1e-6;
+
+        double error = fabs(t - profile_time_at_position(&data, (k + 1) * data.dx));
+        result.max_edge_error = (error > result.max_edge_error) ? error : result.max_edge_error;
+    }
+
+    double h = data.bc.T / BENCHMARK_PEAK_SAMPLES;
+    double a_previous = 0;
+    for (uint32_t i = 1; i < BENCHMARK_PEAK_SAMPLES; i++)
+    {
+        double x_before = profile->position(&data, (i - 1) * h);
+        double x = profile->position(&data, i * h);
+        double x_after = profile->position(&data, (i + 1) * h);
+
+        double v = fabs(x_after - x_before) / (2 * h);
+        double a = (x_after - 2 * x + x_before) / (h * h);
+
+        result.v_peak = (v > result.v_peak) ? v : result.v_peak;
+        result.a_peak = (fabs(a) > result.a_peak) ? fabs(a) : result.a_peak;
+        if (i > 1)
+        {
+            double j = fabs(a - a_previous) / h;
+            result.j_peak = (j > result.j_peak) ? j : result.j_peak;
+        }
+        a_previous = a;
+    }
+
+    free(data.dt_array);
+
+    return result;
+}
+
+
+static void print_profile_benchmark(const char* name, uint32_t xT, profile_benchmark_t result)
+{
+    if (result.n == 0)
+    {
+        printf("%-22s xT=%-6u generation failed\n", name, xT);
+        return;
+    }
+
+    printf("%-22s xT=%-6u T=%.4f s n=%-6u gen=%8.3f ms (%6.1f ns/step)  edge error max=%5.2f us  peaks v=%.0f a=%.0f j=%.3g\n",
+           name, xT, result.T, result.n, result.gen_time * 1e3, result.gen_time * 1e9 / result.n,
+           result.max_edge_error * 1e6, result.v_peak, result.a_peak, result.j_peak);
+}
+
+
+int main(int argc, char** argv)
+{
+    const uint32_t distances[] = {200, 2000, 20000};
+    uint32_t vmax = 5000;   // [steps/s]
+    double amax = 5e4;      // [steps/s^2]
+    double jmax = 2e6;      // [steps/s^3]
+
+    if (argc > 3)
+    {
+        vmax = (uint32_t) atoi(argv[1]);
+        amax = atof(argv[2]);
+        jmax = atof(argv[3]);
+    }
+
+    printf("limits vmax=%u amax=%g jmax=%g\n", vmax, amax, jmax);
+
+    for (uint8_t i = 0; i < sizeof(distances) / sizeof(distances[0]); i++)
+    {
+        print_profile_benchmark("mjt, lut search", distances[i],
+                                run_profile_benchmark(&mjt_profile, MJT_ENGINE_LUT_SEARCH, distances[i], vmax, amax, jmax));
+        print_profile_benchmark("s-curve", distances[i],
+                                run_profile_benchmark(&s_curve_profile, MJT_ENGINE_LUT_SEARCH, distances[i], vmax, amax, jmax));
+    }
+
+    return 0;
+}
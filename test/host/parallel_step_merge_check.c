@@ -0,0 +1,141 @@
+/**
+ * @file parallel_step_merge_check.c
+ * @brief Host check of parallel_step_merge: random multi-axis schedules are merged in buffers and the bit-stream is
+ *        checked against the per-axis step timelines (check_parallel_step_samples). Without a bus gap every edge must
+ *        be exact, with a gap (the bus holds its levels between buffers, as the i80 driver does) the edges after it must
+ *        stay on schedule. The stream must end idle.
+ *
+ *        Build and run from the repository root:
+ *            gcc -O2 -Isrc/platform test/host/parallel_step_merge_check.c src/platform/parallel_step_merge.c -o /tmp/parallel_step_merge_check
+ *            /tmp/parallel_step_merge_check
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "parallel_step_merge.h"
+
+
+#define CHECK_RUNS 200
+#define CHECK_MAX_STEPS 300
+#define CHECK_MAX_DT_US 500
+#define CHECK_SAMPLES_PER_US 2
+
+
+typedef struct merge_check_result
+{
+    int32_t max_error;      // [samples] from check_parallel_step_samples, -1 if edges are missing or extra
+    uint8_t ends_idle;      // last sample low on every axis and nothing generated afterwards
+} merge_check_result_t;
+
+
+/**
+ * @brief Merge random schedules in buffers of buffer_samples and check them. A gap of gap_samples copies of the last
+ *        sample is inserted after every buffer but the last, like the bus does between two transactions.
+ */
+static merge_check_result_t run_merge_check(uint8_t n_axes, uint32_t min_dt, uint32_t buffer_samples, uint32_t gap_samples)
+{
+    merge_check_result_t result = {0};
+    uint32_t* dt_arrays[PARALLEL_STEP_MAX_AXES];
+    uint32_t n_steps[PARALLEL_STEP_MAX_AXES];
+    uint64_t n_max_samples = 2;
+
+    for (uint8_t a = 0; a < n_axes; a++)
+    {
+        uint64_t axis_samples = 0;
+
+        n_steps[a] = (uint32_t) rand() % (CHECK_MAX_STEPS + 1);
+        dt_arrays[a] = malloc((n_steps[a] + 1) * sizeof(uint32_t));
+        for (uint32_t k = 0; k < n_steps[a]; k++)
+        {
+            dt_arrays[a][k] = min_dt + (uint32_t) rand() % (CHECK_MAX_DT_US - min_dt + 1);
+            axis_samples += (uint64_t) (dt_arrays[a][k] + 1) * CHECK_SAMPLES_PER_US;
+        }
+        n_max_samples = (axis_samples > n_max_samples) ? axis_samples : n_max_samples;
+    }
+    n_max_samples += buffer_samples + 1;
+    n_max_samples += (n_max_samples / buffer_samples + 1) * gap_samples;
+
+    uint16_t* stream = malloc(n_max_samples * sizeof(uint16_t));
+    uint16_t* buffer = malloc(buffer_samples * sizeof(uint16_t));
+    uint32_t n_stream = 0;
+
+    parallel_step_merger_t merger;
+    init_parallel_step_merger(&merger, dt_arrays, n_steps, n_axes, CHECK_SAMPLES_PER_US);
+    merger.gap_samples = gap_samples;
+
+    while (1)
+    {
+        uint32_t n = fill_parallel_step_samples(&merger, buffer, buffer_samples);
+
+        if (n_stream > 0 && n > 0)
+        {
+            for (uint32_t k = 0; k < gap_samples; k++)
+            {
+                stream[n_stream + k] = stream[n_stream - 1];
+            }
+            n_stream += gap_samples;
+        }
+        memcpy(&stream[n_stream], buffer, n * sizeof(uint16_t));
+        n_stream += n;
+
+        if (n < buffer_samples)
+        {
+            break;
+        }
+    }
+
+    result.max_error = check_parallel_step_samples(stream, n_stream, CHECK_SAMPLES_PER_US, dt_arrays, n_steps, n_axes);
+    result.ends_idle = merger.done && n_stream > 0 && stream[n_stream - 1] == 0
+                       && fill_parallel_step_samples(&merger, buffer, buffer_samples) == 0;
+
+    free(buffer);
+    free(stream);
+    for (uint8_t a = 0; a < n_axes; a++)
+    {
+        free(dt_arrays[a]);
+    }
+
+    return result;
+}
+
+
+int main(void)
+{
+    const uint32_t buffer_sizes[] = {4096, 257, 25};
+    const uint32_t gap = 12;    // [samples]
+    uint32_t n_failed = 0;
+
+    srand(1);
+
+    for (uint8_t b = 0; b < sizeof(buffer_sizes) / sizeof(buffer_sizes[0]); b++)
+    {
+        for (uint32_t run = 0; run < CHECK_RUNS; run++)
+        {
+            uint8_t n_axes = 1 + (uint8_t) (rand() % PARALLEL_STEP_MAX_AXES);
+
+            // every time step, 0 included (stretched to 2 samples): exact edges
+            merge_check_result_t result = run_merge_check(n_axes, 0, buffer_sizes[b], 0);
+            if (result.max_error != 0 || !result.ends_idle)
+            {
+                printf("FAILED: buffer=%u axes=%u run=%u max error=%d ends idle=%u\n",
+                       buffer_sizes[b], n_axes, run, result.max_error, result.ends_idle);
+                n_failed++;
+            }
+
+            // bus gap between buffers: edges inside a gap are late by the gap at most, the later ones catch up
+            result = run_merge_check(n_axes, 2, buffer_sizes[b], gap);
+            if (result.max_error < 0 || result.max_error > (int32_t) gap || !result.ends_idle)
+            {
+                printf("FAILED: buffer=%u axes=%u run=%u gap=%u max error=%d ends idle=%u\n",
+                       buffer_sizes[b], n_axes, run, gap, result.max_error, result.ends_idle);
+                n_failed++;
+            }
+        }
+    }
+
+    printf("%s: %u of %u merges failed\n", (n_failed == 0) ? "PASSED" : "FAILED", n_failed,
+           2 * CHECK_RUNS * (uint32_t) (sizeof(buffer_sizes) / sizeof(buffer_sizes[0])));
+
+    return (n_failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,191 @@
+/**
+ * @file test_iram_safe_refill.c
+ * @brief On target stress test of the IRAM-safe mode (CONFIG_NO_JERKY_ISR_IRAM_SAFE): long motion curves are output
+ *        one after the other, each as one transaction refilled by the RMT ISR, while a task on the other core keeps
+ *        writing to NVS (the flash cache is disabled during every write). The STEP pin is read back by a GPIO ISR in
+ *        IRAM that records the interval between rising edges of a move: every step must be output and no interval may
+ *        stretch. A move (curve and symbols, 4 B per step each) must fit in internal DRAM next to the NVS task.
+ *
+ *        Nothing needs to be wired, the STEP pin is read back through the GPIO matrix. Build and run:
+ *            idf.py -C test/iram_safe_refill set-target esp32s3 flash monitor
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <driver/gpio.h>
+#include <esp_attr.h>
+#include <esp_timer.h>
+#include <nvs_flash.h>
+#include <nvs.h>
+#include <unity.h>
+
+#include "no_jerky_platform.h"
+
+
+#ifndef TEST_STEP_PIN
+#define TEST_STEP_PIN 4
+#endif
+#ifndef TEST_DIR_PIN
+#define TEST_DIR_PIN 5
+#endif
+#ifndef TEST_ENABLE_PIN
+#define TEST_ENABLE_PIN 6
+#endif
+
+#define TEST_N_STEPS 20000              // 1 s of steps per move, 160 kB of curve and symbols
+#define TEST_N_MOVES 5                  // moves output while the flash is written
+#define TEST_STEP_US 50                 // [us] time step of every step
+#define TEST_MAX_INTERVAL_ERROR_US 10   // [us] GPIO interrupt latency allowance
+#define TEST_NVS_BLOB_SIZE 4000         // [B] written and committed in a loop while the steps are output
+
+
+typedef struct step_edge_stats
+{
+    uint32_t count;
+    uint32_t move_count;    // edges of the current move, intervals are not measured across moves
+    int64_t last_edge;      // [us]
+    int64_t min_interval;   // [us]
+    int64_t max_interval;   // [us]
+} step_edge_stats_t;
+
+
+static volatile step_edge_stats_t step_edges;
+static volatile bool flash_writer_running;
+static volatile uint32_t flash_writer_errors;     // reported to the test case, unity asserts only run in its task
+
+
+static void IRAM_ATTR record_step_edge(void* arg)
+{
+    int64_t now = esp_timer_get_time();
+
+    if (step_edges.move_count > 0)
+    {
+        int64_t interval = now - step_edges.last_edge;
+        step_edges.min_interval = (interval < step_edges.min_interval) ? interval : step_edges.min_interval;
+        step_edges.max_interval = (interval > step_edges.max_interval) ? interval : step_edges.max_interval;
+    }
+
+    step_edges.last_edge = now;
+    step_edges.move_count++;
+    step_edges.count++;
+}
+
+
+/**
+ * @brief Write and commit a blob to NVS until flash_writer_running is cleared.
+ */
+static void flash_writer_task(void* arg)
+{
+    uint8_t* blob = malloc(TEST_NVS_BLOB_SIZE);
+    uint32_t* n_writes = (uint32_t*) arg;
+    nvs_handle_t nvs;
+
+    if (blob == NULL || nvs_open("no_jerky_test", NVS_READWRITE, &nvs) != ESP_OK)
+    {
+        flash_writer_errors++;
+        free(blob);
+        flash_writer_running = true;    // done, see stop_flash_writer()
+        vTaskDelete(NULL);
+        return;
+    }
+
+    while (flash_writer_running)
+    {
+        memset(blob, (uint8_t) *n_writes, TEST_NVS_BLOB_SIZE);
+        if (nvs_set_blob(nvs, "blob", blob, TEST_NVS_BLOB_SIZE) != ESP_OK || nvs_commit(nvs) != ESP_OK)
+        {
+            flash_writer_errors++;
+        }
+        (*n_writes)++;
+    }
+
+    nvs_close(nvs);
+    free(blob);
+    flash_writer_running = true;    // done, see stop_flash_writer()
+    vTaskDelete(NULL);
+}
+
+
+static void stop_flash_writer(void)
+{
+    flash_writer_running = false;
+    while (!flash_writer_running)
+    {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    flash_writer_running = false;
+}
+
+
+TEST_CASE("step intervals hold while the flash is written", "[iram_safe]")
+{
+#if !CONFIG_NO_JERKY_ISR_IRAM_SAFE
+    TEST_IGNORE_MESSAGE("CONFIG_NO_JERKY_ISR_IRAM_SAFE is not enabled");
+#endif
+
+    no_jerky_motor_pins_t pins = {.dir = TEST_DIR_PIN, .step = TEST_STEP_PIN, .enable = TEST_ENABLE_PIN};
+    no_jerky_output_t output = no_jerky_init(pins);
+
+    // read STEP back, the RMT output stays routed to the pin
+    TEST_ASSERT_EQUAL(ESP_OK, gpio_input_enable(TEST_STEP_PIN));
+    TEST_ASSERT_EQUAL(ESP_OK, gpio_set_intr_type(TEST_STEP_PIN, GPIO_INTR_POSEDGE));
+    TEST_ASSERT_EQUAL(ESP_OK, gpio_install_isr_service(ESP_INTR_FLAG_IRAM));
+    TEST_ASSERT_EQUAL(ESP_OK, gpio_isr_handler_add(TEST_STEP_PIN, record_step_edge, NULL));
+
+    step_edges.count = 0;
+    step_edges.min_interval = INT64_MAX;
+    step_edges.max_interval = 0;
+
+    uint32_t* curve = malloc(TEST_N_STEPS * sizeof(uint32_t));
+    TEST_ASSERT_NOT_NULL(curve);
+    for (uint32_t i = 0; i < TEST_N_STEPS; i++)
+    {
+        curve[i] = TEST_STEP_US;
+    }
+
+    uint32_t n_writes = 0;
+    flash_writer_errors = 0;
+    flash_writer_running = true;
+    xTaskCreatePinnedToCore(flash_writer_task, "flash_writer", 4096, &n_writes, 5, NULL, 1);
+    vTaskDelay(pdMS_TO_TICKS(100));
+
+    for (uint8_t move = 0; move < TEST_N_MOVES; move++)
+    {
+        step_edges.move_count = 0;
+        output_not_jerky_motion_curve(output, curve, TEST_N_STEPS);
+        wait_for_motor_motion_done(output);
+    }
+
+    stop_flash_writer();
+    free(curve);
+    gpio_isr_handler_remove(TEST_STEP_PIN);
+    gpio_uninstall_isr_service();
+
+    printf("steps=%lu flash writes=%lu (%lu failed) interval min=%lld us max=%lld us\n",
+           step_edges.count, n_writes, flash_writer_errors, step_edges.min_interval, step_edges.max_interval);
+
+    TEST_ASSERT_EQUAL_UINT32(0, flash_writer_errors);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, n_writes);
+    TEST_ASSERT_EQUAL_UINT32(TEST_N_MOVES * TEST_N_STEPS, step_edges.count);
+    TEST_ASSERT_LESS_OR_EQUAL_INT64(TEST_STEP_US + TEST_MAX_INTERVAL_ERROR_US, step_edges.max_interval);
+    TEST_ASSERT_GREATER_OR_EQUAL_INT64(TEST_STEP_US - TEST_MAX_INTERVAL_ERROR_US, step_edges.min_interval);
+}
+
+
+void app_main(void)
+{
+    esp_err_t err = nvs_flash_init();
+    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND)
+    {
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        err = nvs_flash_init();
+    }
+    ESP_ERROR_CHECK(err);
+
+    UNITY_BEGIN();
+    unity_run_all_tests();
+    UNITY_END();
+}